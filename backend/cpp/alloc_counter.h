@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counting for checking that hot paths stay allocation-free.
+// Only active in builds compiled with GLOWRACE_COUNT_ALLOCS (CMake option
+// GLOWRACE_ALLOC_CHECK), which replaces the global operator new; otherwise
+// enabled() is false and the count stays at zero.
+namespace alloccount {
+
+bool enabled();
+// operator new calls made by the calling thread so far
+uint64_t threadAllocations();
+
+} // namespace alloccount
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Bump allocator for per-tick temporaries; reset() drops everything at once.
+// A request that does not fit spills to the upstream resource, and the next
+// reset regrows the buffer past that tick's high-water mark, so a warmed-up
+// room serves every tick from one block without touching the heap.
+class TickScratch : public std::pmr::memory_resource {
+public:
+    TickScratch(std::pmr::memory_resource* upstream, size_t initialBytes)
+        : upstream(upstream), spills(upstream) {
+        grow(initialBytes);
+    }
+    TickScratch(const TickScratch&) = delete;
+    TickScratch& operator=(const TickScratch&) = delete;
+    ~TickScratch() override {
+        releaseSpills();
+        upstream->deallocate(buffer, capacity, alignof(std::max_align_t));
+    }
+
+    void reset() {
+        size_t highWater = used + spilledBytes;
+        releaseSpills();
+        if (highWater > capacity) {
+            upstream->deallocate(buffer, capacity, alignof(std::max_align_t));
+            grow(highWater + highWater / 2);
+        }
+        used = 0;
+    }
+
+    size_t bytes() const { return capacity; }
+
+private:
+    struct Spill {
+        void* ptr;
+        size_t bytes;
+        size_t alignment;
+    };
+
+    void grow(size_t bytes) {
+        buffer = static_cast<std::byte*>(upstream->allocate(bytes, alignof(std::max_align_t)));
+        capacity = bytes;
+    }
+
+    void releaseSpills() {
+        for (const Spill& spill : spills) upstream->deallocate(spill.ptr, spill.bytes, spill.alignment);
+        spills.clear();
+        spilledBytes = 0;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        uintptr_t base = reinterpret_cast<uintptr_t>(buffer);
+        uintptr_t start = (base + used + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        if (start + bytes <= base + capacity) {
+            used = start + bytes - base;
+            return reinterpret_cast<void*>(start);
+        }
+        void* ptr = upstream->allocate(bytes, alignment);
+        spills.push_back({ptr, bytes, alignment});
+        spilledBytes += bytes;
+        return ptr;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {} // Everything goes at reset
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream;
+    std::byte* buffer = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t spilledBytes = 0;
+    std::pmr::vector<Spill> spills;
+};
+
+// Pass-through to another resource that keeps a running total of the bytes
+// currently held from it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream(upstream) {}
+    CountingResource(const CountingResource&) = delete;
+    CountingResource& operator=(const CountingResource&) = delete;
+
+    size_t bytes() const { return held; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* ptr = upstream->allocate(bytes, alignment);
+        held += bytes;
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        upstream->deallocate(ptr, bytes, alignment);
+        held -= bytes;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream;
+    size_t held = 0;
+};
+
+// Memory behind one room. Long-lived room data (slot arrays, bodies, glow,
+// ids) comes from a pool, so player churn recycles blocks instead of going
+// back to the global heap. Per-tick temporaries such as the published
+// snapshot come from a TickScratch that grows to the room's own high-water
+// mark; it sits beside the pool rather than in it, since the pool would
+// round a large block up to a whole chunk of them. Neither is
+// synchronized: the room's lock guards both. Destroying the arena hands
+// every block back in one step. Everything the arena takes from the heap is
+// counted, so a room can report what it costs.
+class RoomArena {
+public:
+    RoomArena() : pool(poolOptions(), &heap), scratch(&heap, 4 * 1024) {}
+    RoomArena(const RoomArena&) = delete;
+    RoomArena& operator=(const RoomArena&) = delete;
+
+    std::pmr::memory_resource* room() { return &pool; }
+    std::pmr::memory_resource* tick() { return &scratch; }
+    void resetTick() { scratch.reset(); }
+    size_t tickBytes() const { return scratch.bytes(); }
+    // Heap bytes held by the pool and the scratch block, including buffers
+    // too large for the pool that it passed straight through
+    size_t bytesHeld() const { return heap.bytes(); }
+
+private:
+    static std::pmr::pool_options poolOptions() {
+        std::pmr::pool_options options;
+        options.max_blocks_per_chunk = 64;
+        options.largest_required_pool_block = 4 * 1024; // Bigger buffers pass straight through at their exact size
+        return options;
+    }
+
+    CountingResource heap;
+    std::pmr::unsynchronized_pool_resource pool;
+    TickScratch scratch;
+};
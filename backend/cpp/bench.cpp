@@ -0,0 +1,529 @@
+#include "game.h"
+#include "alloc_counter.h"
+#include "arena.h"
+#include "bitboard.h"
+#include "json.hpp"
+#include "log.h"
+#include "protocol.h"
+#include "replay.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using json = nlohmann::json;
+
+struct BenchConfig {
+    int players = 8;
+    int length = 40;
+    int glow = 16;
+    int grid = 50;
+    int ticks = 20000;
+    uint64_t seed = 1;
+};
+
+// Players start on evenly spaced rows heading right with their full tail
+// behind them, so they lap their rows without dying and the board stays busy.
+GameState makeRacingState(const BenchConfig& cfg, pmr::memory_resource* resource = pmr::get_default_resource()) {
+    GameState state(resource);
+    state.setSeed(cfg.seed);
+    int length = min(cfg.length, cfg.grid - 1);
+    for (int k = 0; k < cfg.players; ++k) {
+        int row = static_cast<int>(static_cast<long>(k) * cfg.grid / cfg.players);
+        size_t i = state.addPlayer("P" + to_string(k), "Bench " + to_string(k), {row, length}, Direction::Right);
+        for (int col = 0; col < length; ++col) state.body(i).pushFront({row, col});
+        state.scores[i] = length;
+    }
+    for (int g = 0; g < cfg.glow; ++g) {
+        state.glowPoints.push_back(getRandomPosition(cfg.grid, state, state.rng));
+    }
+    state.initialPlayerCount = state.playerCount();
+    return state;
+}
+
+// Random heads and directions that are churned every tick, so the kernels
+// are compared through head-ons, tail hits and death glow drops.
+GameState makeChaosState(const BenchConfig& cfg, uint64_t seed) {
+    GameState state;
+    state.setSeed(seed);
+    for (int k = 0; k < cfg.players; ++k) {
+        Position head = getRandomPosition(cfg.grid, state, state.rng);
+        state.addPlayer("P" + to_string(k), "Chaos " + to_string(k), head, getRandomDirection(state.rng));
+    }
+    for (int g = 0; g < cfg.glow; ++g) {
+        state.glowPoints.push_back(getRandomPosition(cfg.grid, state, state.rng));
+    }
+    state.initialPlayerCount = state.playerCount();
+    return state;
+}
+
+bool samePositions(const Position& a, const Position& b) {
+    return a.row == b.row && a.col == b.col;
+}
+
+bool sameState(const GameState& a, const GameState& b) {
+    if (a.slotCount() != b.slotCount() || a.glowPoints.size() != b.glowPoints.size() || a.gameOver != b.gameOver) return false;
+    if (memcmp(a.rng.s, b.rng.s, sizeof(a.rng.s)) != 0) return false;
+    if (a.alive != b.alive || a.occupied != b.occupied || a.generations != b.generations) return false;
+    // A free slot's leftovers are never read, so only occupied slots count
+    for (size_t i = 0; i < a.slotCount(); ++i) {
+        if (!a.occupied[i]) continue;
+        if (a.scores[i] != b.scores[i] || a.directions[i] != b.directions[i] || a.idOf(i) != b.idOf(i)) return false;
+        if (!samePositions(a.heads[i], b.heads[i]) || a.body(i).size() != b.body(i).size()) return false;
+        for (size_t k = 0; k < a.body(i).size(); ++k) {
+            if (!samePositions(a.body(i)[k], b.body(i)[k])) return false;
+        }
+    }
+    for (size_t g = 0; g < a.glowPoints.size(); ++g) {
+        if (!samePositions(a.glowPoints[g], b.glowPoints[g])) return false;
+    }
+    return true;
+}
+
+// Runs both kernels in lockstep from many random starts and reports the
+// first tick where they disagree
+bool verifyKernels(const BenchConfig& cfg, EdgeRule rule, long& ticksCompared) {
+    for (uint64_t seed = 1; seed <= 50; ++seed) {
+        GameState reference = makeChaosState(cfg, seed);
+        GameState bitboard = reference;
+        Rng steering(seed * 7919);
+        for (int tick = 0; tick < 500 && !reference.gameOver; ++tick) {
+            for (size_t i = 0; i < reference.slotCount(); ++i) {
+                if (steering.below(4) == 0) {
+                    Direction d = static_cast<Direction>(steering.below(4));
+                    reference.directions[i] = d;
+                    bitboard.directions[i] = d;
+                }
+            }
+            simulateTick(reference, cfg.grid, rule);
+            simulateTickBitboard(bitboard, cfg.grid, rule);
+            ticksCompared++;
+            if (!sameState(reference, bitboard)) {
+                cerr << "Kernel mismatch (" << (rule == EdgeRule::Walls ? "walls" : "wrap") << "): seed " << seed << " tick " << tick << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Encodes chaos rooms mid-game, decodes them into a fresh state and checks
+// the copy then plays on exactly like the original
+bool verifySnapshots(const BenchConfig& cfg, long& roundTrips) {
+    for (uint64_t seed = 1; seed <= 50; ++seed) {
+        GameState original = makeChaosState(cfg, seed);
+        Rng steering(seed * 7919);
+        for (int tick = 0; tick < 100 && !original.gameOver; ++tick) {
+            for (size_t i = 0; i < original.slotCount(); ++i) {
+                if (steering.below(4) == 0) original.directions[i] = static_cast<Direction>(steering.below(4));
+            }
+            simulateTick(original, cfg.grid);
+        }
+        for (size_t i = 0; i < original.slotCount(); ++i) {
+            if (original.occupied[i]) {
+                original.removePlayer(i);
+                break;
+            }
+        }
+        string image;
+        encodeSnapshot(original, cfg.grid, image);
+        GameState decoded;
+        if (!decodeSnapshot(image.data(), image.size(), cfg.grid, decoded) || !sameState(original, decoded)) {
+            cerr << "Snapshot mismatch: seed " << seed << endl;
+            return false;
+        }
+        decoded.addPlayer("late", "Late", getRandomPosition(cfg.grid, decoded, decoded.rng), Direction::Up);
+        original.addPlayer("late", "Late", getRandomPosition(cfg.grid, original, original.rng), Direction::Up);
+        for (int tick = 0; tick < 100; ++tick) {
+            simulateTick(original, cfg.grid);
+            simulateTick(decoded, cfg.grid);
+        }
+        if (!sameState(original, decoded) || decoded.findPlayer("late") != original.findPlayer("late")) {
+            cerr << "Snapshot diverged after decode: seed " << seed << endl;
+            return false;
+        }
+        roundTrips++;
+    }
+    return true;
+}
+
+// Re-simulates a parsed log the way glowrace_replay does; false on a
+// checksum that does not match
+bool replayMatches(const vector<ReplayRecord>& records, long& ticks) {
+    int gridSize = 0;
+    EdgeRule rule = EdgeRule::Wrap;
+    GameState state;
+    bool haveState = false;
+    for (const ReplayRecord& record : records) {
+        switch (record.kind) {
+            case ReplayRecord::Open:
+                gridSize = record.gridSize;
+                rule = record.rule;
+                break;
+            case ReplayRecord::State:
+                state = GameState();
+                if (!decodeSnapshot(record.image.data(), record.image.size(), gridSize, state)) return false;
+                haveState = true;
+                break;
+            case ReplayRecord::Batch:
+                if (!haveState) return false;
+                for (const Action& action : record.actions) applyAction(state, action, gridSize);
+                if (!record.ticked) break;
+                simulateTick(state, gridSize, rule);
+                ticks++;
+                if (stateChecksum(state) != record.checksum) return false;
+                break;
+        }
+    }
+    return true;
+}
+
+// Writes chaos rooms' replay logs the way the server does and checks they
+// replay to the same checksums: once from one server, and once across a hot
+// restart, where the predecessor's records reach the log before the
+// successor appends its own, starting from the image it was handed
+bool verifyReplayLogs(const BenchConfig& cfg, long& ticksReplayed) {
+    for (uint64_t seed = 1; seed <= 20; ++seed) {
+        for (bool handoff : {false, true}) {
+            GameState state = makeChaosState(cfg, seed);
+            Rng steering(seed * 104729);
+            string log;
+            ReplayWriter writer;
+            writer.start();
+            writer.open(cfg.grid, EdgeRule::Wrap);
+            writer.recordState(state, cfg.grid);
+            for (int tick = 0; tick < 100 && !state.gameOver; ++tick) {
+                if (handoff && tick == 50) {
+                    log += writer.take();
+                    string image;
+                    encodeSnapshot(state, cfg.grid, image);
+                    GameState handed;
+                    if (!decodeSnapshot(image.data(), image.size(), cfg.grid, handed)) return false;
+                    state = move(handed);
+                    writer = ReplayWriter();
+                    writer.open(cfg.grid, EdgeRule::Wrap);
+                    writer.recordState(state, cfg.grid);
+                }
+                for (size_t i = 0; i < state.slotCount(); ++i) {
+                    if (!state.occupied[i] || steering.below(4) != 0) continue;
+                    Action action;
+                    action.type = ActionType::ChangeDirection;
+                    action.playerId = string(state.idOf(i));
+                    action.direction = static_cast<Direction>(steering.below(4));
+                    applyAction(state, action, cfg.grid);
+                    writer.recordAction(action);
+                }
+                simulateTick(state, cfg.grid);
+                writer.recordTick(stateChecksum(state));
+            }
+            log += writer.take();
+
+            vector<ReplayRecord> records;
+            string error;
+            if (!parseReplayLog(log.data(), log.size(), records, error) || !replayMatches(records, ticksReplayed)) {
+                cerr << "Replay mismatch (" << (handoff ? "handoff" : "one server") << "): seed " << seed << " " << error << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <class Kernel>
+double nanosPerTick(const GameState& start, const BenchConfig& cfg, Kernel&& kernel) {
+    GameState state = start;
+    auto begin = chrono::steady_clock::now();
+    for (int tick = 0; tick < cfg.ticks; ++tick) kernel(state, cfg.grid);
+    auto elapsed = chrono::steady_clock::now() - begin;
+    return chrono::duration<double, nano>(elapsed).count() / cfg.ticks;
+}
+
+// Drives an arena-backed room the way the server's loop does: tick, reset the
+// scratch, serialize the snapshot into it. The arena is prewarmed by playing
+// the same run on a twin room first, so its pools and scratch already hold
+// the run's high-water mark; after that any heap allocation on a tick is a
+// regression.
+bool checkAllocations(const BenchConfig& cfg, bool bitboard, long& allocatingTicks) {
+    RoomArena arena;
+    TickKernel kernel = bitboard ? findTickKernel(cfg.grid, EdgeRule::Wrap) : nullptr;
+    size_t lastSnapshotBytes = 0;
+    auto tick = [&](GameState& state) {
+        if (kernel) kernel(state);
+        else simulateTick(state, cfg.grid);
+        arena.resetTick();
+        pmr::string snapshot(arena.tick());
+        snapshot.reserve(lastSnapshotBytes + lastSnapshotBytes / 8);
+        appendGameStateJson(state, "bench", snapshot);
+        lastSnapshotBytes = snapshot.size();
+    };
+    {
+        GameState twin = makeRacingState(cfg, arena.room());
+        for (int t = 0; t < cfg.ticks && !twin.gameOver; ++t) tick(twin);
+    }
+
+    GameState state = makeRacingState(cfg, arena.room());
+    for (int t = 0; t < cfg.ticks && !state.gameOver; ++t) {
+        uint64_t before = alloccount::threadAllocations();
+        tick(state);
+        if (alloccount::threadAllocations() != before) allocatingTicks++;
+    }
+    return allocatingTicks == 0;
+}
+
+// Keeps the compiler from dropping a result nothing reads
+template <class T>
+void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Measurement {
+    long iterations = 0;
+    double nsPerOp = 0;    // Median of the timed batches
+    double minNsPerOp = 0; // Best batch
+};
+
+// Doubles the batch until one takes 10 ms (or reaches maxBatch), then times
+// five batches of that size. setup runs untimed before every batch, for ops
+// that wear their input down.
+template <class Setup, class Op>
+Measurement measure(Setup&& setup, Op&& op, long maxBatch = 1L << 30) {
+    constexpr int kRuns = 5;
+    auto timeBatch = [&](long batch) {
+        setup();
+        auto begin = chrono::steady_clock::now();
+        for (long i = 0; i < batch; ++i) op();
+        return chrono::steady_clock::now() - begin;
+    };
+    long batch = 1;
+    while (batch < maxBatch && timeBatch(batch) < chrono::milliseconds(10)) batch = min(batch * 2, maxBatch);
+    double runs[kRuns];
+    for (double& run : runs) run = chrono::duration<double, nano>(timeBatch(batch)).count() / batch;
+    sort(runs, runs + kRuns);
+    return {batch * kRuns, runs[kRuns / 2], runs[0]};
+}
+
+template <class Op>
+Measurement measure(Op&& op) {
+    return measure([] {}, op);
+}
+
+// Each case is one line of JSON, keyed by bench and parameters, so results
+// from two builds can be joined; see compareResults
+json resultLine(const string& bench, const BenchConfig& cfg, const string& label, const Measurement& m) {
+    json line = {{"bench", bench}, {"players", cfg.players}, {"length", cfg.length}, {"glow", cfg.glow},
+                 {"grid", cfg.grid}, {"iterations", m.iterations}, {"ns_per_op", m.nsPerOp},
+                 {"min_ns_per_op", m.minNsPerOp}};
+    if (!label.empty()) line["label"] = label;
+    return line;
+}
+
+string resultKey(const json& line) {
+    return line.value("bench", "") + " players=" + to_string(line.value("players", 0)) + " length=" +
+           to_string(line.value("length", 0)) + " glow=" + to_string(line.value("glow", 0)) + " grid=" +
+           to_string(line.value("grid", 0));
+}
+
+// Micro-benchmarks for the simulation and serialization paths, on a racing
+// board built from cfg. Names matching filter run; an empty filter runs all.
+void runSuite(const BenchConfig& cfg, const string& filter, const string& label, vector<json>& results) {
+    auto run = [&](const string& bench, auto&&... args) {
+        if (!filter.empty() && bench.find(filter) == string::npos) return;
+        results.push_back(resultLine(bench, cfg, label, measure(args...)));
+        cout << results.back().dump() << endl;
+    };
+    const GameState start = makeRacingState(cfg);
+    GameState state;
+
+    // Ticks lengthen tails as glow is eaten, so each batch restarts from the
+    // same board and runs at most cfg.ticks ticks
+    auto restart = [&] { state = start; };
+    run("tick_reference", restart, [&] { simulateTick(state, cfg.grid); }, static_cast<long>(cfg.ticks));
+    if (TickKernel kernel = findTickKernel(cfg.grid, EdgeRule::Wrap)) {
+        run("tick_bitboard", restart, [&] { kernel(state); }, static_cast<long>(cfg.ticks));
+    }
+    // Racing players never meet, so the scan finds nothing and can repeat
+    run("check_collisions", restart, [&] { checkCollisions(state, cfg.grid); });
+
+    Rng rng(cfg.seed);
+    run("random_position", [&] { keep(getRandomPosition(cfg.grid, start, rng)); });
+    long cells = static_cast<long>(cfg.grid) * cfg.grid;
+    long probe = 0;
+    run("position_occupied", [&] {
+        probe = (probe + 7919) % cells;
+        keep(isPositionOccupied(start, {static_cast<int>(probe / cfg.grid), static_cast<int>(probe % cfg.grid)}));
+    });
+
+    run("state_json", [&] { keep(gameStateToJson(start, "bench")); });
+    pmr::string buffer;
+    run("state_json_append", [&] {
+        buffer.clear();
+        appendGameStateJson(start, "bench", buffer);
+        keep(buffer);
+    });
+
+    string loadBody = gameStateToJson(start);
+    run("load_state_parse", [&] {
+        GameState loaded;
+        loaded.setSeed(cfg.seed);
+        parseLoadedState(loadBody, cfg.grid, loaded);
+        keep(loaded);
+    });
+    string updateBody = R"({"room_id":"bench","action":"changeDirection","playerId":"P1","direction":"up","received_at_ms":1700000000000.5})";
+    run("update_parse", [&] { keep(parseUpdateRequest(updateBody)); });
+}
+
+// Flags every case in results more than tolerance (a fraction) slower than
+// the same case in the baseline file. Compares best batches, which shrug off
+// a noisy machine better than medians. Cases missing from either side are
+// skipped.
+bool compareResults(const string& baselinePath, const vector<json>& results, double tolerance) {
+    ifstream in(baselinePath);
+    if (!in) {
+        cerr << "Failed to open baseline " << baselinePath << endl;
+        return false;
+    }
+    map<string, double> baseline;
+    for (string line; getline(in, line);) {
+        if (line.empty()) continue;
+        json parsed = json::parse(line, nullptr, false);
+        if (parsed.is_discarded() || !parsed.is_object()) continue;
+        baseline[resultKey(parsed)] = parsed.value("min_ns_per_op", 0.0);
+    }
+    bool clean = true;
+    for (const json& result : results) {
+        auto it = baseline.find(resultKey(result));
+        if (it == baseline.end() || it->second <= 0) continue;
+        double ratio = result.value("min_ns_per_op", 0.0) / it->second;
+        bool regressed = ratio > 1 + tolerance;
+        clean &= !regressed;
+        cerr << (regressed ? "REGRESSION " : "ok ") << resultKey(result) << ": " << ratio << "x baseline" << endl;
+    }
+    return clean;
+}
+
+// "8" or "2,8,32"
+bool parseList(const char* text, vector<int>& out) {
+    out.clear();
+    for (const char* p = text;;) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0) return false;
+        out.push_back(static_cast<int>(value));
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+        p = end + 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    bool allocCheck = false;
+    bool suite = false;
+    string filter, label, baselinePath;
+    double tolerance = 0.10;
+    // Each sweepable parameter; only --suite takes more than one value
+    vector<int> players{cfg.players}, lengths{cfg.length}, glows{cfg.glow}, grids{cfg.grid};
+    bool validList = true;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        auto valueOf = [&](const char* name) -> const char* {
+            size_t n = strlen(name);
+            return arg.compare(0, n, name) == 0 ? arg.c_str() + n : nullptr;
+        };
+        if (const char* v = valueOf("--players=")) validList &= parseList(v, players);
+        else if (const char* v = valueOf("--length=")) validList &= parseList(v, lengths);
+        else if (const char* v = valueOf("--glow=")) validList &= parseList(v, glows);
+        else if (const char* v = valueOf("--grid=")) validList &= parseList(v, grids);
+        else if (const char* v = valueOf("--ticks=")) cfg.ticks = atoi(v);
+        else if (const char* v = valueOf("--seed=")) cfg.seed = strtoull(v, nullptr, 10);
+        else if (arg == "--alloc-check") allocCheck = true;
+        else if (arg == "--suite") suite = true;
+        else if (const char* v = valueOf("--filter=")) filter = v;
+        else if (const char* v = valueOf("--label=")) label = v;
+        else if (const char* v = valueOf("--compare=")) baselinePath = v;
+        else if (const char* v = valueOf("--tolerance=")) tolerance = atof(v) / 100;
+        else {
+            validList = false;
+            break;
+        }
+    }
+    bool sweep = players.size() > 1 || lengths.size() > 1 || glows.size() > 1 || grids.size() > 1;
+    if (!validList || (sweep && !suite) || (!baselinePath.empty() && !suite)) {
+        cerr << "Usage: glowrace_bench [--players=N] [--length=N] [--glow=N] [--grid=N] [--ticks=N] [--seed=N] [--alloc-check]\n"
+                "       glowrace_bench --suite [--players=N,...] [--length=N,...] [--glow=N,...] [--grid=N,...]\n"
+                "                      [--filter=NAME] [--label=TEXT] [--compare=BASELINE.jsonl [--tolerance=PCT]]"
+             << endl;
+        return 2;
+    }
+    cfg.players = players.front();
+    cfg.length = lengths.front();
+    cfg.glow = glows.front();
+    cfg.grid = grids.front();
+
+    if (suite) {
+        // One JSON line per case on stdout; the comparison goes to stderr
+        glowlog::setMinLevel(glowlog::Level::Off);
+        vector<json> results;
+        for (int p : players) {
+            for (int l : lengths) {
+                for (int g : glows) {
+                    for (int n : grids) {
+                        BenchConfig point = cfg;
+                        point.players = p;
+                        point.length = l;
+                        point.glow = g;
+                        point.grid = n;
+                        runSuite(point, filter, label, results);
+                    }
+                }
+            }
+        }
+        return baselinePath.empty() || compareResults(baselinePath, results, tolerance) ? 0 : 1;
+    }
+    if (!bitboardSupported(cfg.grid)) {
+        cerr << "Grid " << cfg.grid << " has no specialized kernel" << endl;
+        return 2;
+    }
+
+    if (allocCheck) {
+        if (!alloccount::enabled()) {
+            cerr << "--alloc-check needs a build configured with -DGLOWRACE_ALLOC_CHECK=ON" << endl;
+            return 2;
+        }
+        glowlog::setMinLevel(glowlog::Level::Off);
+        long referenceAllocating = 0, bitboardAllocating = 0;
+        bool clean = checkAllocations(cfg, false, referenceAllocating) & checkAllocations(cfg, true, bitboardAllocating);
+        cout << "alloc-check: reference " << referenceAllocating << " allocating ticks, bitboard " << bitboardAllocating
+             << " allocating ticks over " << cfg.ticks << " ticks" << endl;
+        return clean ? 0 : 1;
+    }
+
+    // Keep the core's logging, and its formatting, out of the timings
+    glowlog::setMinLevel(glowlog::Level::Off);
+    long ticksCompared = 0;
+    bool identical = verifyKernels(cfg, EdgeRule::Wrap, ticksCompared) &&
+                     verifyKernels(cfg, EdgeRule::Walls, ticksCompared);
+    long roundTrips = 0;
+    bool snapshots = verifySnapshots(cfg, roundTrips);
+    long ticksReplayed = 0;
+    bool replays = verifyReplayLogs(cfg, ticksReplayed);
+    GameState start = makeRacingState(cfg);
+    double reference = nanosPerTick(start, cfg, [](GameState& state, int gridSize) { simulateTick(state, gridSize); });
+    double bitboard = nanosPerTick(start, cfg, [](GameState& state, int gridSize) { simulateTickBitboard(state, gridSize); });
+
+    cout << "players=" << cfg.players << " length=" << cfg.length << " glow=" << cfg.glow
+         << " grid=" << cfg.grid << " ticks=" << cfg.ticks << endl;
+    cout << "verify: " << (identical ? "identical" : "MISMATCH") << " over " << ticksCompared << " ticks" << endl;
+    cout << "snapshot: " << (snapshots ? "identical" : "MISMATCH") << " over " << roundTrips << " round trips" << endl;
+    cout << "replay: " << (replays ? "identical" : "MISMATCH") << " over " << ticksReplayed << " ticks, handoffs included" << endl;
+    cout << "reference: " << reference << " ns/tick" << endl;
+    cout << "bitboard:  " << bitboard << " ns/tick (" << reference / bitboard << "x)" << endl;
+    return identical && snapshots && replays ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#include "bitboard.h"
+#include "trace.h"
+#include <array>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+void orInto(uint64_t* dst, const uint64_t* src, size_t words) {
+    size_t w = 0;
+#if defined(__AVX2__)
+    for (; w + 4 <= words; w += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + w));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + w), _mm256_or_si256(a, b));
+    }
+#endif
+    for (; w < words; ++w) dst[w] |= src[w];
+}
+
+bool anyAnd(const uint64_t* a, const uint64_t* b, size_t words) {
+    size_t w = 0;
+#if defined(__AVX2__)
+    for (; w + 4 <= words; w += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w));
+        if (!_mm256_testz_si256(x, y)) return true;
+    }
+#endif
+    for (; w < words; ++w) {
+        if (a[w] & b[w]) return true;
+    }
+    return false;
+}
+
+template <int Rows, int Cols, EdgeRule Rule>
+struct Kernel {
+    static constexpr size_t kCells = static_cast<size_t>(Rows) * Cols;
+    static constexpr size_t kWords = (kCells + 63) / 64;
+    using Mask = array<uint64_t, kWords>;
+
+    struct Board {
+        Mask glow;
+        Mask occupancy;
+        Mask heads;
+        Mask headClash; // Cells holding more than one live head
+        Mask bodyUnion;
+        vector<Mask> bodies; // One per slot
+    };
+
+    static size_t cellOf(const Position& pos) {
+        return static_cast<size_t>(pos.row) * Cols + pos.col;
+    }
+
+    static void setBit(Mask& mask, size_t cell) {
+        mask[cell >> 6] |= 1ULL << (cell & 63);
+    }
+
+    static bool testBit(const Mask& mask, size_t cell) {
+        return (mask[cell >> 6] >> (cell & 63)) & 1;
+    }
+
+    // stepPlayer with the direction turned into table lookups and the edge
+    // handling into constant arithmetic
+    static bool step(GameState& state, size_t i) {
+        static constexpr int kRowStep[4] = {-1, 1, 0, 0};
+        static constexpr int kColStep[4] = {0, 0, -1, 1};
+        const Position head = state.heads[i];
+        int d = static_cast<int>(state.directions[i]);
+        int row = head.row + kRowStep[d];
+        int col = head.col + kColStep[d];
+        if constexpr (Rule == EdgeRule::Wrap) {
+            row = (row + Rows) % Rows;
+            col = (col + Cols) % Cols;
+        } else {
+            if (static_cast<unsigned>(row) >= static_cast<unsigned>(Rows) ||
+                static_cast<unsigned>(col) >= static_cast<unsigned>(Cols)) return false;
+        }
+        Body& body = state.body(i);
+        body.pushFront(head);
+        if (body.size() > static_cast<size_t>(state.scores[i])) {
+            body.popBack();
+        }
+        state.heads[i] = {row, col};
+        return true;
+    }
+
+    static void buildGlow(const GameState& state, Board& b) {
+        b.glow.fill(0);
+        for (const auto& glow : state.glowPoints) setBit(b.glow, cellOf(glow));
+    }
+
+    // Same cells isPositionOccupied scans: head and tail of every seated player
+    static void buildOccupancy(const GameState& state, Board& b) {
+        b.occupancy.fill(0);
+        for (size_t i = 0; i < state.slotCount(); ++i) {
+            if (!state.occupied[i]) continue;
+            setBit(b.occupancy, cellOf(state.heads[i]));
+            const Body& body = state.body(i);
+            for (size_t k = 0; k < body.size(); ++k) setBit(b.occupancy, cellOf(body[k]));
+        }
+    }
+
+    // getRandomPosition with the occupancy scan replaced by a bit probe. Draws
+    // and the give-up rule match it exactly.
+    static Position spawnCell(Rng& rng, const Board& b) {
+        Position pos;
+        int attempts = 0;
+        do {
+            pos.row = static_cast<int>(rng.below(Rows));
+            pos.col = static_cast<int>(rng.below(Cols));
+            attempts++;
+            if (attempts >= static_cast<int>(kCells)) break;
+        } while (testBit(b.occupancy, cellOf(pos)));
+        return pos;
+    }
+
+    static void moveAndCollect(GameState& state, Board& b) {
+        glowtrace::Span span("move");
+        buildGlow(state, b);
+        for (size_t i = 0; i < state.slotCount(); ++i) {
+            if (!state.alive[i]) continue;
+            if (!step(state, i)) {
+                // The dropped tail is glow the players after this one can collect
+                killPlayer(state, i);
+                state.killed[i] = 1;
+                buildGlow(state, b);
+                continue;
+            }
+            if (!state.glowPoints.empty() && !testBit(b.glow, cellOf(state.heads[i]))) continue;
+            // Occupancy only changes as players move, so one build serves every
+            // spawn this pickup needs
+            glowtrace::Span pickup("glow_pickup");
+            bool occupancyReady = false;
+            collectGlow(state, i, [&]() {
+                if (!occupancyReady) {
+                    buildOccupancy(state, b);
+                    occupancyReady = true;
+                }
+                return spawnCell(state.rng, b);
+            });
+            buildGlow(state, b);
+        }
+    }
+
+    static void collide(GameState& state, Board& b) {
+        glowtrace::Span span("collide");
+        size_t count = state.slotCount();
+        b.heads.fill(0);
+        b.headClash.fill(0);
+        b.bodyUnion.fill(0);
+        for (size_t j = 0; j < count; ++j) {
+            if (!state.alive[j]) continue;
+            Mask& mask = b.bodies[j];
+            mask.fill(0);
+            const Body& body = state.body(j);
+            for (size_t k = 0; k < body.size(); ++k) setBit(mask, cellOf(body[k]));
+            orInto(b.bodyUnion.data(), mask.data(), kWords);
+            size_t head = cellOf(state.heads[j]);
+            if (testBit(b.heads, head)) setBit(b.headClash, head);
+            setBit(b.heads, head);
+        }
+        bool clash = false;
+        for (uint64_t word : b.headClash) clash |= word != 0;
+        // Nobody's head is on a tail or another head: nothing to resolve
+        if (!clash && !anyAnd(b.heads.data(), b.bodyUnion.data(), kWords)) {
+            releaseKilled(state);
+            return;
+        }
+
+        // Same order and outcomes as checkCollisions; the masks only answer
+        // "is this head on player j's tail" and skip players that hit nothing.
+        for (size_t i = 0; i < count; ++i) {
+            if (!state.alive[i]) continue;
+            size_t head = cellOf(state.heads[i]);
+            if (!testBit(b.bodyUnion, head) && !testBit(b.headClash, head)) continue;
+            for (size_t j = 0; j < count && state.alive[i]; ++j) {
+                if (i == j || !state.alive[j]) continue;
+                const Position& otherHead = state.heads[j];
+                if (state.heads[i].row == otherHead.row && state.heads[i].col == otherHead.col) {
+                    resolveHeadOn(state, i, j);
+                    continue;
+                }
+                if (testBit(b.bodies[j], head)) {
+                    killPlayer(state, i);
+                    state.killed[i] = 1;
+                }
+            }
+        }
+        releaseKilled(state);
+    }
+
+    static void run(GameState& state) {
+        // Scratch is reused across ticks; each room ticks on its own thread
+        static thread_local Board board;
+        if (board.bodies.size() < state.slotCount()) board.bodies.resize(state.slotCount());
+        state.killed.resize(state.slotCount(), 0);
+        moveAndCollect(state, board);
+        collide(state, board);
+        glowtrace::Span span("game_over");
+        checkGameOver(state);
+    }
+};
+
+template <int Size>
+TickKernel squareKernel(EdgeRule rule) {
+    return rule == EdgeRule::Wrap ? &Kernel<Size, Size, EdgeRule::Wrap>::run
+                                  : &Kernel<Size, Size, EdgeRule::Walls>::run;
+}
+
+} // namespace
+
+TickKernel findTickKernel(int gridSize, EdgeRule rule) {
+    switch (gridSize) {
+        case 20: return squareKernel<20>(rule);
+        case 30: return squareKernel<30>(rule);
+        case 40: return squareKernel<40>(rule);
+        case 50: return squareKernel<50>(rule);
+        case 64: return squareKernel<64>(rule);
+        case 100: return squareKernel<100>(rule);
+    }
+    return nullptr;
+}
+
+bool bitboardSupported(int gridSize) {
+    return findTickKernel(gridSize, EdgeRule::Wrap) != nullptr;
+}
+
+void simulateTickBitboard(GameState& state, int gridSize, EdgeRule rule) {
+    if (TickKernel kernel = findTickKernel(gridSize, rule)) {
+        kernel(state);
+    } else {
+        simulateTick(state, gridSize, rule);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "game.h"
+
+// A tick compiled for one board shape and edge rule
+using TickKernel = void (*)(GameState& state);
+
+// Bitboard kernel specialized for this board, or nullptr if the size has no
+// compiled-in instantiation (square boards of 20, 30, 40, 50, 64 and 100).
+//
+// Board dimensions are template constants, so cell indexing and wraparound
+// are constant arithmetic with no edge branches, and the glow, occupancy and
+// collision masks are fixed-size arrays. Glow pickup and spawn rejection are
+// bit probes, and collisions are skipped outright when no head overlaps the
+// OR of the live bodies. The resulting state, including the room's Rng, is
+// bit-identical to simulateTick.
+TickKernel findTickKernel(int gridSize, EdgeRule rule);
+
+bool bitboardSupported(int gridSize);
+
+// Specialized kernel when one exists, simulateTick otherwise
+void simulateTickBitboard(GameState& state, int gridSize, EdgeRule rule = EdgeRule::Wrap);
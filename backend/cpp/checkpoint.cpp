@@ -0,0 +1,138 @@
+#include "checkpoint.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char kMagic[4] = {'G', 'R', 'C', 'P'};
+
+uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 1469598103934665603ULL) {
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    return hash;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+bool writeCheckpoint(const string& path, int gridSize, const vector<CheckpointRoom>& rooms) {
+    CheckpointHeader header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kCheckpointVersion;
+    header.gridSize = static_cast<uint32_t>(gridSize);
+    header.roomCount = static_cast<uint32_t>(rooms.size());
+    header.writtenAtMs = static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now().time_since_epoch()).count());
+
+    vector<CheckpointEntry> directory(rooms.size());
+    uint64_t offset = sizeof(CheckpointHeader) + sizeof(CheckpointEntry) * rooms.size();
+    for (size_t i = 0; i < rooms.size(); ++i) {
+        const CheckpointRoom& room = rooms[i];
+        directory[i].offset = offset;
+        directory[i].idBytes = static_cast<uint32_t>(room.roomId.size());
+        directory[i].snapshotBytes = static_cast<uint32_t>(room.snapshot.size());
+        directory[i].checksum = fnv1a(room.snapshot.data(), room.snapshot.size(),
+                                      fnv1a(room.roomId.data(), room.roomId.size()));
+        offset += room.roomId.size() + room.snapshot.size();
+    }
+    header.fileBytes = offset;
+
+    string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+              writeAll(fd, reinterpret_cast<const char*>(directory.data()), sizeof(CheckpointEntry) * directory.size());
+    for (size_t i = 0; i < rooms.size() && ok; ++i) {
+        ok = writeAll(fd, rooms[i].roomId.data(), rooms[i].roomId.size()) &&
+             writeAll(fd, rooms[i].snapshot.data(), rooms[i].snapshot.size());
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedCheckpoint::~MappedCheckpoint() {
+    if (base) munmap(const_cast<char*>(base), length);
+}
+
+bool MappedCheckpoint::open(const string& path, int gridSize, string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "no checkpoint at " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CheckpointHeader)) {
+        close(fd);
+        error = "checkpoint is truncated";
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "mmap failed";
+        return false;
+    }
+    base = static_cast<const char*>(mapped);
+    madvise(mapped, length, MADV_WILLNEED);
+
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a checkpoint file";
+        return false;
+    }
+    if (header.version != kCheckpointVersion) {
+        error = "checkpoint version " + to_string(header.version) + ", expected " + to_string(kCheckpointVersion);
+        return false;
+    }
+    if (header.gridSize != static_cast<uint32_t>(gridSize)) {
+        error = "checkpoint is for a " + to_string(header.gridSize) + " board";
+        return false;
+    }
+    uint64_t directoryEnd = sizeof(CheckpointHeader) + sizeof(CheckpointEntry) * static_cast<uint64_t>(header.roomCount);
+    if (header.fileBytes != length || directoryEnd > length) {
+        error = "checkpoint is truncated";
+        return false;
+    }
+    entries.resize(header.roomCount);
+    memcpy(entries.data(), base + sizeof(CheckpointHeader), sizeof(CheckpointEntry) * entries.size());
+    for (const CheckpointEntry& entry : entries) {
+        if (entry.offset < directoryEnd || entry.offset + entry.idBytes + entry.snapshotBytes > length) {
+            entries.clear();
+            error = "checkpoint directory points outside the file";
+            return false;
+        }
+    }
+    return true;
+}
+
+string_view MappedCheckpoint::roomId(size_t i) const {
+    return {base + entries[i].offset, entries[i].idBytes};
+}
+
+bool MappedCheckpoint::snapshot(size_t i, const char*& data, size_t& size) const {
+    const CheckpointEntry& entry = entries[i];
+    if (fnv1a(base + entry.offset, entry.idBytes + entry.snapshotBytes) != entry.checksum) return false;
+    data = base + entry.offset + entry.idBytes;
+    size = entry.snapshotBytes;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Checkpoint of every room in one file, laid out for mmap on boot:
+//
+//   CheckpointHeader
+//   CheckpointEntry[roomCount]      fixed-size directory
+//   blobs                           room id bytes, then its snapshot image
+//
+// Snapshot images are the encoding from snapshot.h. Fields are native
+// little-endian; any change to the layout bumps kCheckpointVersion. Each
+// blob carries an FNV-1a checksum so entries can be validated independently,
+// and in parallel, without trusting the rest of the file.
+
+constexpr uint32_t kCheckpointVersion = 1;
+
+struct CheckpointHeader {
+    char magic[4]; // "GRCP"
+    uint32_t version;
+    uint32_t gridSize;
+    uint32_t roomCount;
+    uint64_t writtenAtMs; // System clock, for logging the checkpoint's age
+    uint64_t fileBytes;
+};
+
+struct CheckpointEntry {
+    uint64_t offset; // Of the blob, from the start of the file
+    uint32_t idBytes;
+    uint32_t snapshotBytes;
+    uint64_t checksum; // Over the whole blob
+};
+
+struct CheckpointRoom {
+    std::string roomId;
+    std::string snapshot;
+};
+
+// Writes the rooms to a temporary file next to path, syncs it and renames it
+// over path, so a crash mid-write leaves the previous checkpoint intact
+bool writeCheckpoint(const std::string& path, int gridSize, const std::vector<CheckpointRoom>& rooms);
+
+// Read-only mapping of a checkpoint file. open() checks the header and
+// directory bounds; blobs are only checksummed when asked for, so callers
+// can spread that across threads.
+class MappedCheckpoint {
+public:
+    MappedCheckpoint() = default;
+    MappedCheckpoint(const MappedCheckpoint&) = delete;
+    MappedCheckpoint& operator=(const MappedCheckpoint&) = delete;
+    ~MappedCheckpoint();
+
+    // False with a reason in error if the file is missing, foreign, from
+    // another version or board size, or truncated
+    bool open(const std::string& path, int gridSize, std::string& error);
+
+    size_t roomCount() const { return entries.size(); }
+    uint64_t writtenAtMs() const { return header.writtenAtMs; }
+    std::string_view roomId(size_t i) const;
+    // Checks the blob's checksum and points data at its snapshot image
+    bool snapshot(size_t i, const char*& data, size_t& size) const;
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+    CheckpointHeader header{};
+    std::vector<CheckpointEntry> entries;
+};
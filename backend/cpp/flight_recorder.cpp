@@ -0,0 +1,172 @@
+#include "flight_recorder.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace flight {
+
+namespace {
+
+string directory = "/tmp/glowrace-flight";
+
+// Dumps asked for by threads that could not reach the room, by room id
+mutex requestsMutex;
+unordered_map<string, pair<const char*, chrono::steady_clock::time_point>> requests;
+atomic<bool> anyRequests{false};
+constexpr auto kRequestLapse = chrono::seconds(30);
+
+int64_t toNs(chrono::steady_clock::time_point time) {
+    return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+const char* actionName(ActionType type) {
+    switch (type) {
+        case ActionType::AddPlayer: return "addPlayer";
+        case ActionType::ChangeDirection: return "changeDirection";
+        case ActionType::EndGame: return "endGame";
+    }
+    return "unknown";
+}
+
+const char* resultName(ActionResult result) {
+    switch (result) {
+        case ActionResult::Ignored: return "ignored";
+        case ActionResult::Added: return "added";
+        case ActionResult::Rejoined: return "rejoined";
+        case ActionResult::Turned: return "turned";
+        case ActionResult::Ended: return "ended";
+    }
+    return "unknown";
+}
+
+double toMs(int64_t us) {
+    return static_cast<double>(us) / 1e3;
+}
+
+} // namespace
+
+void Recorder::noteInput(int slot, const Action& action, ActionResult result, chrono::steady_clock::time_point applied) {
+    if (pendingCount < kInputs) {
+        pending[pendingCount] = {0, slot < 0 ? kNoSlot : static_cast<uint16_t>(slot), action.type, action.direction, result};
+        pendingAppliedNs[pendingCount] = toNs(applied);
+    }
+    if (pendingCount < UINT16_MAX) pendingCount++;
+}
+
+void Recorder::takeInputs(Tick& tick) {
+    tick.inputCount = pendingCount;
+    size_t kept = min<size_t>(pendingCount, kInputs);
+    for (size_t i = 0; i < kept; i++) {
+        tick.inputs[i] = pending[i];
+        tick.inputs[i].appliedUs = static_cast<uint32_t>(max<int64_t>(0, (tick.startNs - pendingAppliedNs[i]) / 1000));
+    }
+    pendingCount = 0;
+}
+
+Tick& Recorder::begin(chrono::steady_clock::time_point start) {
+    Tick& tick = ring[written++ % kTicks];
+    tick = Tick{};
+    tick.startNs = toNs(start);
+    return tick;
+}
+
+string Recorder::dump(const string& roomId, const string& fileStem, const char* reason,
+                      const vector<pair<uint16_t, string>>& players) {
+    auto now = chrono::steady_clock::now();
+    if (written == 0) return {};
+    if (lastDump != chrono::steady_clock::time_point() && now - lastDump < kDumpGap) {
+        suppressed++;
+        return {};
+    }
+    lastDump = now;
+    int64_t nowNs = toNs(now);
+    int64_t unixMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+    json ticks = json::array();
+    size_t kept = min(written, kTicks);
+    for (size_t i = written - kept; i < written; i++) {
+        const Tick& tick = ring[i % kTicks];
+        json inputs = json::array();
+        for (size_t k = 0; k < min<size_t>(tick.inputCount, kInputs); k++) {
+            const Input& input = tick.inputs[k];
+            json entry = {{"action", actionName(input.type)},
+                          {"result", resultName(input.result)},
+                          {"applied_ms_before", toMs(input.appliedUs)}};
+            if (input.slot != kNoSlot) entry["slot"] = input.slot;
+            if (input.type == ActionType::ChangeDirection) entry["direction"] = directionName(input.direction);
+            inputs.push_back(move(entry));
+        }
+        json flags = json::array();
+        if (tick.flags & LockTimeout) flags.push_back("lock_timeout");
+        if (tick.flags & PublishFailed) flags.push_back("publish_failed");
+        if (tick.flags & Overrun) flags.push_back("overrun");
+        char checksum[17];
+        snprintf(checksum, sizeof(checksum), "%016llx", static_cast<unsigned long long>(tick.checksum));
+        ticks.push_back({{"tick", tick.tick},
+                         {"started_ms_ago", static_cast<double>(nowNs - tick.startNs) / 1e6},
+                         {"checksum", checksum},
+                         {"lateness_ms", toMs(tick.latenessUs)},
+                         {"lock_wait_ms", {{"loop", toMs(tick.loopWaitUs)}, {"tick", toMs(tick.tickWaitUs)}, {"publish", toMs(tick.publishWaitUs)}}},
+                         {"simulate_ms", toMs(tick.simulateUs)},
+                         {"snapshot_ms", toMs(tick.snapshotUs)},
+                         {"publish_ms", toMs(tick.publishUs)},
+                         {"cpu_ms", toMs(tick.cpuUs)},
+                         {"players", tick.players},
+                         {"alive", tick.alive},
+                         {"glow", tick.glow},
+                         {"inputs_applied", tick.inputCount},
+                         {"inputs", move(inputs)},
+                         {"flags", move(flags)}});
+    }
+    json slots = json::object();
+    for (const auto& [slot, id] : players) slots[to_string(slot)] = id;
+    json report = {{"room_id", roomId},
+                   {"reason", reason},
+                   {"dumped_at_ms", unixMs},
+                   {"suppressed_dumps", suppressed},
+                   {"players", move(slots)},
+                   {"ticks", move(ticks)}};
+    suppressed = 0;
+
+    error_code error;
+    filesystem::create_directories(directory, error);
+    string path = directory + "/" + fileStem + "-" + to_string(unixMs) + "-" + reason + ".json";
+    ofstream out(path);
+    out << report.dump() << '\n';
+    return out ? path : string();
+}
+
+void setDirectory(const string& dir) {
+    directory = dir;
+}
+
+void requestDump(const string& roomId, const char* reason) {
+    auto now = chrono::steady_clock::now();
+    lock_guard<mutex> lock(requestsMutex);
+    for (auto it = requests.begin(); it != requests.end();) {
+        if (now - it->second.second > kRequestLapse) it = requests.erase(it);
+        else ++it;
+    }
+    requests[roomId] = {reason, now};
+    anyRequests.store(true, memory_order_relaxed);
+}
+
+bool takeRequest(const string& roomId, const char*& reason) {
+    if (!anyRequests.load(memory_order_relaxed)) return false;
+    lock_guard<mutex> lock(requestsMutex);
+    auto it = requests.find(roomId);
+    if (it == requests.end()) return false;
+    reason = it->second.first;
+    requests.erase(it);
+    anyRequests.store(!requests.empty(), memory_order_relaxed);
+    return true;
+}
+
+} // namespace flight
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "game.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The last few seconds of one room, kept so an overrun tick, a lock timeout
+// or a 503 can be explained after the fact instead of from one log line:
+//
+//   flight::Tick& tick = room.flight.begin(now);
+//   ...the tick fills in its phases...
+//   if (overran) room.flight.dump(roomId, fileStem, "overrun", players);
+//
+// The ring is a fixed array inside the room. Only the room's loop thread
+// touches it, so recording is plain stores, with no lock and no allocation.
+// Dumps format and write a file, at most one per kDumpGap per room.
+
+namespace flight {
+
+constexpr size_t kTicks = 50; // 10 s at the 200 ms cadence
+constexpr size_t kInputs = 8; // Actions kept per tick; inputCount covers the rest
+constexpr auto kDumpGap = std::chrono::seconds(10);
+constexpr uint16_t kNoSlot = UINT16_MAX;
+
+struct Input {
+    uint32_t appliedUs; // Before the tick started
+    uint16_t slot;      // Player slot, kNoSlot if the player is not in the room
+    ActionType type;
+    Direction direction;
+    ActionResult result;
+};
+
+enum Flag : uint8_t {
+    LockTimeout = 1,   // The tick gave up waiting for the game lock
+    PublishFailed = 2, // FastAPI did not take the frame
+    Overrun = 4,       // The tick took longer than the budget
+};
+
+struct Tick {
+    uint64_t tick;
+    int64_t startNs;  // Steady clock
+    uint64_t checksum; // stateChecksum after the tick
+    int32_t latenessUs;
+    uint32_t loopWaitUs, tickWaitUs, publishWaitUs; // Game lock waits
+    uint32_t simulateUs, snapshotUs, publishUs, cpuUs;
+    uint16_t players, alive, glow;
+    uint16_t inputCount; // Every action applied since the previous tick
+    uint8_t flags;
+    Input inputs[kInputs];
+};
+
+// Durations as the records keep them, clamped to fit
+inline uint32_t micros(std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return static_cast<uint32_t>(us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : us);
+}
+
+class Recorder {
+public:
+    // Actions applied between ticks. Caller holds the game lock.
+    void noteInput(int slot, const Action& action, ActionResult result, std::chrono::steady_clock::time_point applied);
+    // Moves the noted actions into tick. Caller holds the game lock.
+    void takeInputs(Tick& tick);
+    void dropInputs() { pendingCount = 0; }
+
+    // The rest is the loop thread's alone.
+
+    // Starts the next tick record, overwriting the oldest
+    Tick& begin(std::chrono::steady_clock::time_point start);
+    // The record begin last returned
+    Tick& current() { return ring[(written - 1) % kTicks]; }
+    bool empty() const { return written == 0; }
+
+    // Writes the kept ticks, oldest first, to <dir>/<fileStem>-<unix ms>-<reason>.json
+    // and returns its path; empty if nothing was written, e.g. within kDumpGap
+    // of the last dump. players maps slots to ids, as far as the caller knows
+    // them.
+    std::string dump(const std::string& roomId, const std::string& fileStem, const char* reason,
+                     const std::vector<std::pair<uint16_t, std::string>>& players);
+
+private:
+    std::array<Tick, kTicks> ring;
+    size_t written = 0;
+    std::chrono::steady_clock::time_point lastDump;
+    uint32_t suppressed = 0; // Dumps skipped since the last one
+
+    std::array<Input, kInputs> pending;
+    std::array<int64_t, kInputs> pendingAppliedNs;
+    uint16_t pendingCount = 0; // May pass kInputs; only the first kInputs are kept
+};
+
+// Where dumps go; GLOWRACE_FLIGHT_DIR, created on first use
+void setDirectory(const std::string& dir);
+
+// For threads other than the room's loop: asks the loop to dump the room on
+// its next pass. Requests for rooms whose loop is gone lapse after a while.
+void requestDump(const std::string& roomId, const char* reason);
+// The loop's side; false at the cost of one relaxed load when nothing is pending
+bool takeRequest(const std::string& roomId, const char*& reason);
+
+} // namespace flight
@@ -0,0 +1,376 @@
+#include "game.h"
+#include <charconv>
+#include "log.h"
+#include "trace.h"
+
+using namespace std;
+
+// Direction strings only exist at the JSON boundary; the tick works on the enum.
+bool parseDirection(const string& text, Direction& out) {
+    if (text == "up") out = Direction::Up;
+    else if (text == "down") out = Direction::Down;
+    else if (text == "left") out = Direction::Left;
+    else if (text == "right") out = Direction::Right;
+    else return false;
+    return true;
+}
+
+const char* directionName(Direction direction) {
+    switch (direction) {
+        case Direction::Up: return "up";
+        case Direction::Down: return "down";
+        case Direction::Left: return "left";
+        case Direction::Right: return "right";
+    }
+    return "right";
+}
+
+// Check if a position is occupied by any snake
+bool isPositionOccupied(const GameState& state, const Position& pos) {
+    GLOWRACE_LOG(Trace) << "Checking if position (" << pos.row << "," << pos.col << ") is occupied";
+    for (size_t i = 0; i < state.slotCount(); ++i) {
+        if (!state.occupied[i]) continue;
+        const Position& head = state.heads[i];
+        GLOWRACE_LOG(Trace) << "Checking player " << state.idOf(i) << " head (" << head.row << "," << head.col << ")";
+        if (head.row == pos.row && head.col == pos.col) {
+            GLOWRACE_LOG(Trace) << "Position occupied by player head";
+            return true;
+        }
+        const Body& body = state.body(i);
+        for (size_t k = 0; k < body.size(); ++k) {
+            const Position& segment = body[k];
+            GLOWRACE_LOG(Trace) << "Checking tail segment (" << segment.row << "," << segment.col << ")";
+            if (segment.row == pos.row && segment.col == pos.col) {
+                GLOWRACE_LOG(Trace) << "Position occupied by player tail";
+                return true;
+            }
+        }
+    }
+    GLOWRACE_LOG(Trace) << "Position not occupied";
+    return false;
+}
+
+// Generate a random position that is not occupied
+Position getRandomPosition(int gridSize, const GameState& state, Rng& rng) {
+    GLOWRACE_LOG(Trace) << "Generating random position for grid size " << gridSize;
+    Position pos;
+    int maxAttempts = gridSize * gridSize;
+    int attempts = 0;
+    do {
+        pos.row = static_cast<int>(rng.below(gridSize));
+        pos.col = static_cast<int>(rng.below(gridSize));
+        GLOWRACE_LOG(Trace) << "Attempt " << attempts + 1 << ": Generated position (" << pos.row << "," << pos.col << ")";
+        attempts++;
+        if (attempts >= maxAttempts) {
+            GLOWRACE_LOG(Warn) << "Warning: Could not find an unoccupied position after " << maxAttempts << " attempts, using (" << pos.row << "," << pos.col << ")";
+            break;
+        }
+    } while (isPositionOccupied(state, pos));
+    GLOWRACE_LOG(Trace) << "Final position: (" << pos.row << "," << pos.col << ")";
+    return pos;
+}
+
+// Generate a random direction
+Direction getRandomDirection(Rng& rng) {
+    Direction direction = static_cast<Direction>(rng.below(4));
+    GLOWRACE_LOG(Trace) << "Generated direction: " << directionName(direction);
+    return direction;
+}
+
+namespace {
+
+template <class Out>
+void appendInt(Out& out, long value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+// Quoted and escaped the way nlohmann::json dumps strings
+template <class Out, class Str>
+void appendQuoted(Out& out, const Str& text) {
+    static const char* hex = "0123456789abcdef";
+    out.push_back('"');
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default:
+                if (c < 0x20) {
+                    char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    out.append(escaped, sizeof(escaped));
+                } else {
+                    out.push_back(static_cast<char>(c));
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+template <class Out>
+void appendCell(Out& out, const Position& pos) {
+    out.append("{\"col\":");
+    appendInt(out, pos.col);
+    out.append(",\"row\":");
+    appendInt(out, pos.row);
+    out.push_back('}');
+}
+
+// Written by hand rather than through nlohmann::json so serializing a tick
+// builds no DOM. Keys are in the same (sorted) order json::dump produced.
+template <class Out>
+void appendJson(const GameState& state, const string& roomId, Out& out) {
+    out.append("{\"gameOver\":");
+    out.append(state.gameOver ? "true" : "false");
+    out.append(",\"glowPoints\":[");
+    for (size_t g = 0; g < state.glowPoints.size(); ++g) {
+        if (g > 0) out.push_back(',');
+        appendCell(out, state.glowPoints[g]);
+    }
+    out.append("],\"players\":[");
+    bool first = true;
+    for (size_t i = 0; i < state.slotCount(); ++i) {
+        if (!state.occupied[i]) continue;
+        if (!first) out.push_back(',');
+        first = false;
+        out.append("{\"alive\":");
+        out.append(state.alive[i] ? "true" : "false");
+        out.append(",\"col\":");
+        appendInt(out, state.heads[i].col);
+        out.append(",\"direction\":\"");
+        out.append(directionName(state.directions[i]));
+        out.append("\",\"id\":");
+        appendQuoted(out, state.idOf(i));
+        out.append(",\"name\":");
+        appendQuoted(out, state.names[i]);
+        out.append(",\"row\":");
+        appendInt(out, state.heads[i].row);
+        out.append(",\"score\":");
+        appendInt(out, state.scores[i]);
+        out.append(",\"tail\":[");
+        const Body& body = state.body(i);
+        for (size_t k = 0; k < body.size(); ++k) {
+            if (k > 0) out.push_back(',');
+            appendCell(out, body[k]);
+        }
+        out.append("]}");
+    }
+    out.append("],\"room_id\":");
+    appendQuoted(out, roomId);
+    out.push_back('}');
+}
+
+} // namespace
+
+string gameStateToJson(const GameState& state, const string& roomId) {
+    string out;
+    appendJson(state, roomId, out);
+    return out;
+}
+
+void appendGameStateJson(const GameState& state, const string& roomId, pmr::string& out) {
+    appendJson(state, roomId, out);
+}
+
+Position wrapToBoard(const Position& pos, int gridSize) {
+    return {((pos.row % gridSize) + gridSize) % gridSize, ((pos.col % gridSize) + gridSize) % gridSize};
+}
+
+Position getNextPosition(const Position& head, Direction direction, int gridSize) {
+    Position next = head;
+    switch (direction) {
+        case Direction::Up: next.row--; break;
+        case Direction::Down: next.row++; break;
+        case Direction::Left: next.col--; break;
+        case Direction::Right: next.col++; break;
+    }
+    if (next.row < 0) next.row = gridSize - 1;
+    if (next.row >= gridSize) next.row = 0;
+    if (next.col < 0) next.col = gridSize - 1;
+    if (next.col >= gridSize) next.col = 0;
+    return next;
+}
+
+// Kill player i and drop its tail as glow points
+void killPlayer(GameState& state, size_t i) {
+    state.alive[i] = 0;
+    const Body& body = state.body(i);
+    for (size_t k = 0; k < body.size(); ++k) {
+        state.glowPoints.push_back(body[k]);
+    }
+}
+
+// Head-on meeting of players i and j: the higher score survives, a tie kills both
+void resolveHeadOn(GameState& state, size_t i, size_t j) {
+    auto& killed = state.killed;
+    GLOWRACE_LOG(Debug) << "Head-to-head collision between player " << state.idOf(i) << " and player " << state.idOf(j);
+    if (state.scores[i] > state.scores[j]) {
+        killPlayer(state, j);
+        killed[j] = 1;
+        GLOWRACE_LOG(Debug) << "Player " << state.idOf(j) << " killed by player " << state.idOf(i) << " (score comparison)";
+    } else if (state.scores[i] < state.scores[j]) {
+        killPlayer(state, i);
+        killed[i] = 1;
+        GLOWRACE_LOG(Debug) << "Player " << state.idOf(i) << " killed by player " << state.idOf(j) << " (score comparison)";
+    } else {
+        killPlayer(state, i);
+        killPlayer(state, j);
+        killed[i] = killed[j] = 1;
+        GLOWRACE_LOG(Debug) << "Both players " << state.idOf(i) << " and " << state.idOf(j) << " killed (equal scores)";
+    }
+}
+
+// Players killed in a collision pass release their slot once the pass is
+// done; players that ended their own game keep it with alive=false.
+void releaseKilled(GameState& state) {
+    for (size_t i = 0; i < state.killed.size(); ++i) {
+        if (state.killed[i]) {
+            state.removePlayer(i);
+            state.killed[i] = 0;
+        }
+    }
+}
+
+void checkCollisions(GameState& state, int gridSize) {
+    size_t count = state.slotCount();
+    state.killed.resize(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (!state.alive[i]) continue;
+        Position currentPos = state.heads[i];
+
+        for (size_t j = 0; j < count && state.alive[i]; ++j) {
+            if (i == j || !state.alive[j]) continue;
+            const Position& otherHead = state.heads[j];
+            if (currentPos.row == otherHead.row && currentPos.col == otherHead.col) {
+                resolveHeadOn(state, i, j);
+                continue;
+            }
+            const Body& body = state.body(j);
+            for (size_t k = 0; k < body.size(); ++k) {
+                if (currentPos.row == body[k].row && currentPos.col == body[k].col) {
+                    killPlayer(state, i);
+                    state.killed[i] = 1;
+                    GLOWRACE_LOG(Debug) << "Player " << state.idOf(i) << " collided with tail of player " << state.idOf(j) << " at (" << body[k].row << "," << body[k].col << ")";
+                    break;
+                }
+            }
+        }
+    }
+    releaseKilled(state);
+}
+
+void checkGameOver(GameState& state) {
+    int aliveCount = 0;
+    for (uint8_t a : state.alive) {
+        if (a) aliveCount++;
+    }
+    state.gameOver = (aliveCount == 0);
+    GLOWRACE_LOG(Trace) << "Checked game over: aliveCount=" << aliveCount << ", initialPlayerCount=" << state.initialPlayerCount << ", gameOver=" << state.gameOver;
+}
+
+static bool facesWall(const Position& head, Direction direction, int gridSize) {
+    switch (direction) {
+        case Direction::Up: return head.row == 0;
+        case Direction::Down: return head.row == gridSize - 1;
+        case Direction::Left: return head.col == 0;
+        case Direction::Right: return head.col == gridSize - 1;
+    }
+    return false;
+}
+
+bool stepPlayer(GameState& state, size_t i, int gridSize, EdgeRule rule) {
+    if (rule == EdgeRule::Walls && facesWall(state.heads[i], state.directions[i], gridSize)) return false;
+    Position next = getNextPosition(state.heads[i], state.directions[i], gridSize);
+    Body& body = state.body(i);
+    body.pushFront(state.heads[i]);
+    if (body.size() > static_cast<size_t>(state.scores[i])) {
+        body.popBack();
+    }
+    state.heads[i] = next;
+    return true;
+}
+
+// Advance every live snake one cell, then resolve glow pickups
+void movePlayers(GameState& state, int gridSize, EdgeRule rule) {
+    glowtrace::Span span("move");
+    state.killed.resize(state.slotCount(), 0);
+    for (size_t i = 0; i < state.slotCount(); ++i) {
+        if (!state.alive[i]) continue;
+        if (!stepPlayer(state, i, gridSize, rule)) {
+            killPlayer(state, i);
+            state.killed[i] = 1;
+            continue;
+        }
+        glowtrace::Span pickup("glow_pickup");
+        collectGlow(state, i, [&]() { return getRandomPosition(gridSize, state, state.rng); });
+    }
+}
+
+void simulateTick(GameState& state, int gridSize, EdgeRule rule) {
+    movePlayers(state, gridSize, rule);
+    {
+        glowtrace::Span span("collide");
+        checkCollisions(state, gridSize);
+    }
+    glowtrace::Span span("game_over");
+    checkGameOver(state);
+}
+
+bool shouldResetGameState(const GameState& state) {
+    if (state.playerCount() == 0) return true;
+    for (uint8_t a : state.alive) {
+        if (a) return false;
+    }
+    return true;
+}
+
+void resetPlayerState(GameState& state, size_t i, int gridSize) {
+    state.heads[i] = getRandomPosition(gridSize, GameState(), state.rng);
+    state.body(i).clear();
+    state.directions[i] = getRandomDirection(state.rng);
+    state.scores[i] = 0;
+    state.alive[i] = 1;
+}
+
+bool parseActionType(const string& text, ActionType& out) {
+    if (text == "addPlayer") out = ActionType::AddPlayer;
+    else if (text == "changeDirection") out = ActionType::ChangeDirection;
+    else if (text == "endGame") out = ActionType::EndGame;
+    else return false;
+    return true;
+}
+
+ActionResult applyAction(GameState& state, const Action& action, int gridSize) {
+    int index = state.findPlayer(action.playerId);
+    switch (action.type) {
+        case ActionType::AddPlayer:
+            if (index < 0) {
+                Position startPos = getRandomPosition(gridSize, state, state.rng);
+                Direction startDirection = getRandomDirection(state.rng);
+                state.addPlayer(action.playerId, action.name, startPos, startDirection);
+                state.initialPlayerCount = state.playerCount();
+                return ActionResult::Added;
+            }
+            if (state.gameOver) {
+                resetPlayerState(state, index, gridSize);
+                state.gameOver = false;
+                checkGameOver(state);
+                return ActionResult::Rejoined;
+            }
+            return ActionResult::Ignored;
+        case ActionType::ChangeDirection:
+            if (index < 0) return ActionResult::Ignored;
+            state.directions[index] = action.direction;
+            return ActionResult::Turned;
+        case ActionType::EndGame:
+            if (index >= 0) state.alive[index] = 0;
+            checkGameOver(state);
+            return index >= 0 ? ActionResult::Ended : ActionResult::Ignored;
+    }
+    return ActionResult::Ignored;
+}
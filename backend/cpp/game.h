@@ -0,0 +1,435 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Largest board this build can hold. Stored cells use the narrowest
+// coordinate type that fits, so the default of 256 packs a cell into two
+// bytes; the server refuses larger GLOWRACE_GRID_SIZE values.
+#ifndef GLOWRACE_MAX_GRID
+#define GLOWRACE_MAX_GRID 256
+#endif
+constexpr int kMaxGridSize = GLOWRACE_MAX_GRID;
+using Coord = std::conditional_t<(GLOWRACE_MAX_GRID <= 256), uint8_t,
+                                 std::conditional_t<(GLOWRACE_MAX_GRID <= 65536), uint16_t, uint32_t>>;
+
+enum class Direction : uint8_t { Up, Down, Left, Right };
+
+// Direction strings only exist at the JSON boundary; the tick works on the enum.
+bool parseDirection(const std::string& text, Direction& out);
+const char* directionName(Direction direction);
+
+// What happens to a snake that runs off the board
+enum class EdgeRule : uint8_t { Wrap, Walls };
+
+// Working coordinates: what the movement and collision code computes with
+struct Position {
+    int row, col;
+};
+
+// Stored coordinates: what tails and glow points keep per cell. Always on
+// the board, so the narrow Coord is enough.
+struct Cell {
+    Coord row, col;
+
+    Cell() = default;
+    Cell(const Position& pos) : row(static_cast<Coord>(pos.row)), col(static_cast<Coord>(pos.col)) {}
+    operator Position() const { return {row, col}; }
+};
+
+// Player id held in place when it fits, which covers the ids the frontend
+// mints. Longer ids are marked spilled and kept in GameState::longIds.
+struct ShortId {
+    static constexpr size_t kCapacity = 23;
+    static constexpr uint8_t kSpilled = 0xff;
+
+    char text[kCapacity];
+    uint8_t length = 0;
+
+    bool spilled() const { return length == kSpilled; }
+    std::string_view view() const { return {text, length}; }
+    void assign(std::string_view id) {
+        if (id.size() > kCapacity) {
+            length = kSpilled;
+            return;
+        }
+        std::memcpy(text, id.data(), id.size());
+        length = static_cast<uint8_t>(id.size());
+    }
+};
+
+// Tail segments of one snake, newest first. Kept in a power-of-two ring so a
+// move is a push at the front and a pop at the back without shifting the rest.
+// Allocator-aware so the ring comes from whatever arena holds the body.
+struct Body {
+    using allocator_type = std::pmr::polymorphic_allocator<Position>;
+
+    std::pmr::vector<Cell> ring;
+    size_t start = 0;
+    size_t length = 0;
+
+    Body() = default;
+    explicit Body(const allocator_type& alloc) : ring(alloc) {}
+    Body(const Body& other, const allocator_type& alloc) : ring(other.ring, alloc), start(other.start), length(other.length) {}
+    Body(Body&& other, const allocator_type& alloc) : ring(std::move(other.ring), alloc), start(other.start), length(other.length) {}
+    Body(const Body&) = default;
+    Body(Body&&) = default;
+    Body& operator=(const Body&) = default;
+    Body& operator=(Body&&) = default;
+
+    size_t size() const { return length; }
+    size_t capacity() const { return ring.size(); }
+    Position operator[](size_t i) const { return ring[(start + i) & (ring.size() - 1)]; }
+    void clear() { start = 0; length = 0; }
+    void pushFront(const Position& pos) {
+        if (length == ring.size()) grow();
+        start = (start - 1) & (ring.size() - 1);
+        ring[start] = pos;
+        length++;
+    }
+    void popBack() {
+        if (length > 0) length--;
+    }
+
+private:
+    void grow() {
+        std::pmr::vector<Cell> bigger(ring.empty() ? 8 : ring.size() * 2, ring.get_allocator());
+        for (size_t i = 0; i < length; ++i) bigger[i] = ring[(start + i) & (ring.size() - 1)];
+        ring.swap(bigger);
+        start = 0;
+    }
+};
+
+// xoshiro256** seeded through splitmix64. Every room owns one, so draws never
+// touch shared state and a room's whole sequence is reproducible from its seed.
+struct Rng {
+    uint64_t s[4];
+
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed) {
+        for (auto& word : s) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, bound). Lemire's multiply-shift with rejection, so the
+    // sequence does not depend on the standard library's distributions.
+    uint32_t below(uint32_t bound) {
+        uint64_t m = (next() >> 32) * bound;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < bound) {
+            uint32_t threshold = (0u - bound) % bound;
+            while (low < threshold) {
+                m = (next() >> 32) * bound;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// Stable reference to a player slot. The generation is bumped whenever the
+// slot is released, so a handle held across a death no longer resolves.
+struct PlayerHandle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Per-room simulation state, laid out as parallel arrays indexed by player
+// slot. Slots never move: a death releases the slot for reuse instead of
+// erasing it, so indices stay valid for the lifetime of the player. The hot
+// arrays are all the movement, glow and collision phases touch; ids and
+// names are cold and only read at the /update boundary and when serializing.
+// The id index is an open-addressed table of slots that compares against
+// the ids array, so each id is stored once.
+// Every container draws from the memory resource given at construction,
+// normally the owning room's arena. Copies land on the default heap.
+struct GameState {
+    // Hot
+    std::pmr::vector<Position> heads;
+    std::pmr::vector<Direction> directions;
+    std::pmr::vector<uint8_t> alive;
+    std::pmr::vector<int> scores;
+    std::pmr::vector<uint32_t> bodyHandles; // Index into bodies
+    // Slot bookkeeping
+    std::pmr::vector<uint8_t> occupied;
+    std::pmr::vector<uint32_t> generations;
+    std::pmr::vector<uint32_t> freeSlots;
+    std::pmr::vector<uint32_t> idIndex; // slot + 1 per bucket; 0 is empty, kErased a removed entry
+    // Cold
+    std::pmr::vector<ShortId> ids;
+    std::pmr::unordered_map<uint32_t, std::pmr::string> longIds; // By slot, for ids too long for ShortId
+    std::pmr::vector<std::pmr::string> names;
+
+    std::pmr::vector<Body> bodies;
+    std::pmr::vector<uint32_t> freeBodies; // Released bodies keep their ring for reuse
+    std::pmr::vector<Cell> glowPoints;
+    std::pmr::vector<uint8_t> killed; // Tick scratch: slots to release after collisions, all zero between ticks
+    bool gameOver = false;
+    int initialPlayerCount = 0;
+    size_t livePlayers = 0;
+    size_t indexUsed = 0; // Buckets holding a slot or kErased
+    uint64_t seed = 0;
+    Rng rng; // Every random draw for this room goes through here
+
+    explicit GameState(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : heads(resource), directions(resource), alive(resource), scores(resource), bodyHandles(resource),
+          occupied(resource), generations(resource), freeSlots(resource), idIndex(resource),
+          ids(resource), longIds(resource), names(resource), bodies(resource), freeBodies(resource), glowPoints(resource),
+          killed(resource) {}
+
+    std::pmr::memory_resource* resource() const { return heads.get_allocator().resource(); }
+
+    void setSeed(uint64_t value) {
+        seed = value;
+        rng.reseed(value);
+    }
+
+    // Room for this many players before any of them joins, so the first
+    // joins allocate nothing; used to prewarm pooled rooms
+    void reserve(size_t players) {
+        heads.reserve(players);
+        directions.reserve(players);
+        alive.reserve(players);
+        scores.reserve(players);
+        bodyHandles.reserve(players);
+        occupied.reserve(players);
+        generations.reserve(players);
+        freeSlots.reserve(players);
+        ids.reserve(players);
+        names.reserve(players);
+        bodies.reserve(players);
+        freeBodies.reserve(players);
+        killed.reserve(players);
+        if (idIndex.empty()) rebuildIndex(players * 4 / 3 + 1);
+    }
+
+    size_t slotCount() const { return heads.size(); }
+    size_t playerCount() const { return livePlayers; }
+    Body& body(size_t i) { return bodies[bodyHandles[i]]; }
+    const Body& body(size_t i) const { return bodies[bodyHandles[i]]; }
+
+    size_t addPlayer(const std::string& id, const std::string& name, const Position& head, Direction direction) {
+        uint32_t handle;
+        if (!freeBodies.empty()) {
+            handle = freeBodies.back();
+            freeBodies.pop_back();
+            bodies[handle].clear();
+        } else {
+            handle = static_cast<uint32_t>(bodies.size());
+            bodies.emplace_back();
+        }
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            heads[slot] = head;
+            directions[slot] = direction;
+            alive[slot] = 1;
+            scores[slot] = 0;
+            bodyHandles[slot] = handle;
+            occupied[slot] = 1;
+            names[slot].assign(name.data(), name.size());
+        } else {
+            slot = static_cast<uint32_t>(heads.size());
+            heads.push_back(head);
+            directions.push_back(direction);
+            alive.push_back(1);
+            scores.push_back(0);
+            bodyHandles.push_back(handle);
+            occupied.push_back(1);
+            generations.push_back(0);
+            ids.emplace_back();
+            names.emplace_back(name.data(), name.size());
+        }
+        ids[slot].assign(id);
+        if (ids[slot].spilled()) longIds[slot].assign(id.data(), id.size());
+        indexInsert(slot);
+        livePlayers++;
+        return slot;
+    }
+
+    void removePlayer(size_t i) {
+        indexErase(static_cast<uint32_t>(i));
+        if (ids[i].spilled()) longIds.erase(static_cast<uint32_t>(i));
+        livePlayers--;
+        freeBodies.push_back(bodyHandles[i]);
+        alive[i] = 0;
+        occupied[i] = 0;
+        generations[i]++;
+        freeSlots.push_back(static_cast<uint32_t>(i));
+    }
+
+    std::string_view idOf(size_t i) const {
+        return ids[i].spilled() ? std::string_view(longIds.at(static_cast<uint32_t>(i))) : ids[i].view();
+    }
+
+    int findPlayer(std::string_view id) const {
+        if (idIndex.empty()) return -1;
+        size_t mask = idIndex.size() - 1;
+        for (size_t b = hashId(id) & mask;; b = (b + 1) & mask) {
+            uint32_t entry = idIndex[b];
+            if (entry == 0) return -1;
+            if (entry != kErased && idOf(entry - 1) == id) return static_cast<int>(entry - 1);
+        }
+    }
+
+    PlayerHandle handleOf(size_t i) const {
+        return {static_cast<uint32_t>(i), generations[i]};
+    }
+
+    // Slot for a handle, or -1 if that player has since been removed
+    int resolve(const PlayerHandle& handle) const {
+        if (handle.slot >= slotCount() || !occupied[handle.slot] || generations[handle.slot] != handle.generation) return -1;
+        return static_cast<int>(handle.slot);
+    }
+
+    // Recount players and rebuild the id index after the slot arrays were
+    // filled in directly, as when decoding a snapshot
+    void reindex() {
+        livePlayers = 0;
+        for (uint8_t o : occupied) livePlayers += o;
+        rebuildIndex(livePlayers * 4);
+    }
+
+private:
+    static constexpr uint32_t kErased = UINT32_MAX;
+
+    static size_t hashId(std::string_view id) { return std::hash<std::string_view>()(id); }
+
+    // The slot must already be marked occupied
+    void indexInsert(uint32_t slot) {
+        // Keep at least a quarter of the buckets empty so probes stay short;
+        // a rebuild picks the new slot up along with the rest
+        if ((indexUsed + 1) * 4 > idIndex.size() * 3) {
+            rebuildIndex((livePlayers + 1) * 4);
+            return;
+        }
+        size_t mask = idIndex.size() - 1;
+        size_t b = hashId(idOf(slot)) & mask;
+        while (idIndex[b] != 0 && idIndex[b] != kErased) b = (b + 1) & mask;
+        if (idIndex[b] == 0) indexUsed++;
+        idIndex[b] = slot + 1;
+    }
+
+    void indexErase(uint32_t slot) {
+        size_t mask = idIndex.size() - 1;
+        for (size_t b = hashId(idOf(slot)) & mask; idIndex[b] != 0; b = (b + 1) & mask) {
+            if (idIndex[b] == slot + 1) {
+                idIndex[b] = kErased;
+                return;
+            }
+        }
+    }
+
+    void rebuildIndex(size_t minBuckets) {
+        size_t buckets = 16;
+        while (buckets < minBuckets) buckets *= 2;
+        idIndex.assign(buckets, 0);
+        indexUsed = 0;
+        size_t mask = buckets - 1;
+        for (uint32_t slot = 0; slot < slotCount(); ++slot) {
+            if (!occupied[slot]) continue;
+            size_t b = hashId(idOf(slot)) & mask;
+            while (idIndex[b] != 0) b = (b + 1) & mask;
+            idIndex[b] = slot + 1;
+            indexUsed++;
+        }
+    }
+};
+
+
+bool isPositionOccupied(const GameState& state, const Position& pos);
+Position getRandomPosition(int gridSize, const GameState& state, Rng& rng);
+Direction getRandomDirection(Rng& rng);
+// Snapshot JSON as sent to FastAPI and returned from /update
+std::string gameStateToJson(const GameState& state, const std::string& roomId = "");
+// Same document appended to a caller-owned buffer, e.g. one in a room's
+// per-tick scratch arena
+void appendGameStateJson(const GameState& state, const std::string& roomId, std::pmr::string& out);
+
+// Map any coordinate onto the board; used on positions loaded from outside
+Position wrapToBoard(const Position& pos, int gridSize);
+Position getNextPosition(const Position& head, Direction direction, int gridSize);
+// Move player i one cell along its direction, growing the tail up to its
+// score. Returns false, without moving, if the player ran into a wall.
+bool stepPlayer(GameState& state, size_t i, int gridSize, EdgeRule rule = EdgeRule::Wrap);
+void killPlayer(GameState& state, size_t i);
+void resolveHeadOn(GameState& state, size_t i, size_t j);
+void releaseKilled(GameState& state);
+void checkCollisions(GameState& state, int gridSize);
+void checkGameOver(GameState& state);
+void movePlayers(GameState& state, int gridSize, EdgeRule rule = EdgeRule::Wrap);
+// One full simulation step: movement and glow pickup, collisions, game over.
+// Works for any board size; the specialized kernels in bitboard.h must match
+// it exactly. Callers hold whatever lock guards the state.
+void simulateTick(GameState& state, int gridSize, EdgeRule rule = EdgeRule::Wrap);
+bool shouldResetGameState(const GameState& state);
+void resetPlayerState(GameState& state, size_t i, int gridSize);
+
+// Player actions as /update receives them, validated at the boundary
+enum class ActionType : uint8_t { AddPlayer, ChangeDirection, EndGame };
+bool parseActionType(const std::string& text, ActionType& out);
+
+struct Action {
+    ActionType type = ActionType::AddPlayer;
+    std::string playerId;
+    std::string name;                       // AddPlayer only
+    Direction direction = Direction::Right; // ChangeDirection only
+};
+
+// What applying an action did; Ignored means it changed nothing
+enum class ActionResult : uint8_t { Ignored, Added, Rejoined, Turned, Ended };
+
+// Applies one action between ticks. The server and the replayer both go
+// through here, so a logged action replays exactly, random draws included.
+ActionResult applyAction(GameState& state, const Action& action, int gridSize);
+
+// Glow pickup for player i after it has moved: every glow point under the
+// head is consumed for a point and replaced by a cell from spawn(), and the
+// board never runs out of glow. Shared by every tick kernel so they draw from
+// the room's Rng in exactly the same order.
+template <class Spawn>
+void collectGlow(GameState& state, size_t i, Spawn&& spawn) {
+    const Position head = state.heads[i];
+    for (size_t g = 0; g < state.glowPoints.size();) {
+        const Position glow = state.glowPoints[g];
+        if (head.row == glow.row && head.col == glow.col) {
+            state.scores[i]++;
+            state.glowPoints.erase(state.glowPoints.begin() + g);
+            state.glowPoints.push_back(spawn());
+        } else {
+            ++g;
+        }
+    }
+    if (state.glowPoints.empty()) {
+        state.glowPoints.push_back(spawn());
+    }
+}
@@ -0,0 +1,423 @@
+#include "httplib.h"
+#include "game.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace httplib;
+
+// Stress test for the whole server on one box. Simulated players join rooms
+// and send /update actions the way FastAPI forwards them, one connection per
+// action, while a built-in mock of FastAPI takes the frames the server
+// publishes. Start the server against the mock:
+//
+//   GLOWRACE_BACKEND=127.0.0.1:8000 ./server &
+//   ./glowrace_loadgen --rooms=200 --players=4000 --duration=60
+
+struct LoadConfig {
+    string serverHost = "127.0.0.1";
+    int serverPort = 9000;
+    int rooms = 100;
+    int players = 1000;
+    double duration = 30;    // Seconds, counted from the first join
+    double ramp = 5;         // Joins are spread over this many seconds
+    double turnRate = 2;     // changeDirection per player per second
+    double endRate = 0.02;   // endGame per player per second
+    double rejoinDelay = 3;  // Seconds before a player who ended plays again
+    int senders = 32;        // /update requests in flight at most
+    uint64_t seed = 1;
+    bool mock = true;
+    int mockPort = 8000;
+    int mockThreads = 64;    // Each injected delay holds one
+    double mockLatencyMs = 1;
+    double mockJitterMs = 1; // Added uniformly on top of the latency
+    double mockFailPercent = 0;
+};
+
+double uniform(Rng& rng) {
+    return static_cast<double>(rng.next() >> 11) * 0x1p-53;
+}
+
+// Seconds until the next event of a Poisson process
+double exponential(Rng& rng, double rate) {
+    return -log1p(-uniform(rng)) / rate;
+}
+
+// FastAPI and Redis for the server under test: keeps each room's last
+// frame, answers /load_state and /check_reset from it like main.py does,
+// and counts ticks from the number each tick frame carries
+class MockBackend {
+public:
+    explicit MockBackend(const LoadConfig& cfg) : cfg(cfg) {}
+
+    bool start() {
+        server.new_task_queue = [this] { return new ThreadPool(static_cast<size_t>(cfg.mockThreads)); };
+        server.Post("/state", [this](const Request& req, Response& res) { handleState(req, res); });
+        server.Get("/load_state", [this](const Request& req, Response& res) { handleLoadState(req, res); });
+        server.Get("/check_reset", [this](const Request& req, Response& res) { handleCheckReset(req, res); });
+        if (!server.bind_to_port("0.0.0.0", cfg.mockPort)) return false;
+        listener = thread([this] { server.listen_after_bind(); });
+        return true;
+    }
+
+    void stop() {
+        server.stop();
+        if (listener.joinable()) listener.join();
+    }
+
+    struct RoomFrames {
+        string last;             // Empty once the game is over, as FastAPI deletes it
+        uint64_t tickFrames = 0; // Frames stamped with a tick
+        uint64_t ticks = 0;      // Ticks advanced between the first and latest of them
+        uint64_t lastTick = 0;
+        chrono::steady_clock::time_point first, latest;
+    };
+
+    // Copies each room's counts out
+    vector<RoomFrames> roomFrames() {
+        lock_guard<mutex> lock(roomsMutex);
+        vector<RoomFrames> out;
+        for (const auto& [roomId, room] : rooms) {
+            if (room.tickFrames > 0) out.push_back({string(), room.tickFrames, room.ticks, room.lastTick, room.first, room.latest});
+        }
+        return out;
+    }
+
+    atomic<uint64_t> stateRequests{0};
+    atomic<uint64_t> loadRequests{0};
+    atomic<uint64_t> checkRequests{0};
+    atomic<uint64_t> injectedFailures{0};
+
+private:
+    // Waits out the injected latency; false if this request should fail
+    bool delay() {
+        thread_local Rng rng(cfg.seed ^ hash<thread::id>()(this_thread::get_id()));
+        double ms = cfg.mockLatencyMs + cfg.mockJitterMs * uniform(rng);
+        if (ms > 0) this_thread::sleep_for(chrono::duration<double, milli>(ms));
+        if (cfg.mockFailPercent <= 0 || uniform(rng) * 100 >= cfg.mockFailPercent) return true;
+        injectedFailures++;
+        return false;
+    }
+
+    static void fail(Response& res) {
+        res.status = 500;
+        res.set_content("{\"status\":\"error\",\"message\":\"Injected failure\"}", "application/json");
+    }
+
+    void handleState(const Request& req, Response& res) {
+        stateRequests++;
+        if (!delay()) return fail(res);
+        const string& body = req.body;
+        static const string roomKey = "\"room_id\":\"";
+        size_t start = body.find(roomKey);
+        if (start == string::npos) {
+            res.status = 400;
+            return;
+        }
+        start += roomKey.size();
+        string roomId = body.substr(start, body.find('"', start) - start);
+        // Tick frames end with ,"tick":N}; the echo after an /update has none
+        size_t tickAt = body.rfind(",\"tick\":");
+        auto now = chrono::steady_clock::now();
+        bool over = body.find("\"gameOver\":true") != string::npos;
+        lock_guard<mutex> lock(roomsMutex);
+        RoomFrames& room = rooms[roomId];
+        if (over) room.last.clear();
+        else room.last = body;
+        if (tickAt != string::npos) {
+            uint64_t tick = strtoull(body.c_str() + tickAt + 8, nullptr, 10);
+            if (room.tickFrames == 0) room.first = now;
+            else if (tick > room.lastTick) room.ticks += tick - room.lastTick; // Lower means the room was made again
+            room.lastTick = tick;
+            room.latest = now;
+            room.tickFrames++;
+        }
+        res.set_content("{\"status\":\"success\",\"deleted\":false}", "application/json");
+    }
+
+    void handleLoadState(const Request& req, Response& res) {
+        loadRequests++;
+        if (!delay()) return fail(res);
+        string roomId = req.get_param_value("room_id");
+        lock_guard<mutex> lock(roomsMutex);
+        auto it = rooms.find(roomId);
+        if (it != rooms.end() && !it->second.last.empty()) {
+            res.set_content(it->second.last, "application/json");
+        } else {
+            res.set_content("{\"gameOver\":false,\"glowPoints\":[],\"players\":[]}", "application/json");
+        }
+    }
+
+    void handleCheckReset(const Request& req, Response& res) {
+        checkRequests++;
+        if (!delay()) return fail(res);
+        string roomId = req.get_param_value("room_id");
+        lock_guard<mutex> lock(roomsMutex);
+        auto it = rooms.find(roomId);
+        // Reset when there is no state or nobody in it is alive
+        bool reset = it == rooms.end() || it->second.last.find("\"alive\":true") == string::npos;
+        res.set_content(reset ? "{\"reset\":true}" : "{\"reset\":false}", "application/json");
+    }
+
+    const LoadConfig& cfg;
+    Server server;
+    thread listener;
+    mutex roomsMutex;
+    unordered_map<string, RoomFrames> rooms;
+};
+
+enum class Step : uint8_t { Join, Turn, End };
+
+struct Scheduled {
+    double at; // Seconds since the load began
+    uint32_t player;
+    Step step;
+    bool operator>(const Scheduled& other) const { return at > other.at; }
+};
+
+// What one sender saw; merged after the run
+struct SenderStats {
+    vector<uint32_t> latencyUs; // Every /update that got a response
+    uint64_t sent[3] = {};      // By Step
+    uint64_t ok = 0;
+    uint64_t badRequest = 0;
+    uint64_t unavailable = 0;   // 503: lock timeouts and restarts
+    uint64_t otherErrors = 0;
+    uint64_t noResponse = 0;
+};
+
+atomic<uint64_t> sentTotal{0};
+atomic<uint64_t> unavailableTotal{0};
+
+// Drives the players p with p % senders == index, one request at a time.
+// Each player joins during the ramp, then turns and ends as Poisson
+// processes, and plays again rejoinDelay after ending.
+void runSender(const LoadConfig& cfg, int index, chrono::steady_clock::time_point begin, SenderStats& stats) {
+    Rng rng(cfg.seed * 7919 + static_cast<uint64_t>(index));
+    priority_queue<Scheduled, vector<Scheduled>, greater<Scheduled>> schedule;
+    for (int p = index; p < cfg.players; p += cfg.senders) {
+        schedule.push({uniform(rng) * cfg.ramp, static_cast<uint32_t>(p), Step::Join});
+    }
+    double actionRate = cfg.turnRate + cfg.endRate;
+    static const char* directions[] = {"up", "down", "left", "right"};
+    char body[256];
+    while (!schedule.empty() && schedule.top().at < cfg.duration) {
+        Scheduled next = schedule.top();
+        schedule.pop();
+        this_thread::sleep_until(begin + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(next.at)));
+
+        int room = static_cast<int>(next.player % static_cast<uint32_t>(cfg.rooms));
+        double receivedAtMs = chrono::duration<double, milli>(chrono::system_clock::now().time_since_epoch()).count();
+        switch (next.step) {
+            case Step::Join:
+                snprintf(body, sizeof(body),
+                         "{\"room_id\":\"load-%d\",\"action\":\"addPlayer\",\"playerId\":\"p%u\",\"name\":\"Load %u\",\"received_at_ms\":%.3f}",
+                         room, next.player, next.player, receivedAtMs);
+                break;
+            case Step::Turn:
+                snprintf(body, sizeof(body),
+                         "{\"room_id\":\"load-%d\",\"action\":\"changeDirection\",\"playerId\":\"p%u\",\"direction\":\"%s\",\"received_at_ms\":%.3f}",
+                         room, next.player, directions[rng.below(4)], receivedAtMs);
+                break;
+            case Step::End:
+                snprintf(body, sizeof(body),
+                         "{\"room_id\":\"load-%d\",\"action\":\"endGame\",\"playerId\":\"p%u\",\"received_at_ms\":%.3f}",
+                         room, next.player, receivedAtMs);
+                break;
+        }
+
+        Client cli(cfg.serverHost, cfg.serverPort);
+        cli.set_connection_timeout(5);
+        cli.set_read_timeout(15); // Past the server's 10 s lock timeout
+        auto start = chrono::steady_clock::now();
+        auto res = cli.Post("/update", body, "application/json");
+        auto elapsed = chrono::steady_clock::now() - start;
+        stats.sent[static_cast<int>(next.step)]++;
+        sentTotal++;
+        if (!res) {
+            stats.noResponse++;
+        } else {
+            stats.latencyUs.push_back(static_cast<uint32_t>(min<int64_t>(
+                chrono::duration_cast<chrono::microseconds>(elapsed).count(), UINT32_MAX)));
+            if (res->status == 200) stats.ok++;
+            else if (res->status == 400) stats.badRequest++;
+            else if (res->status == 503) {
+                stats.unavailable++;
+                unavailableTotal++;
+            } else stats.otherErrors++;
+        }
+
+        double now = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        if (next.step == Step::End) {
+            schedule.push({now + cfg.rejoinDelay, next.player, Step::Join});
+        } else if (actionRate > 0) {
+            Step step = uniform(rng) * actionRate < cfg.endRate ? Step::End : Step::Turn;
+            schedule.push({now + exponential(rng, actionRate), next.player, step});
+        }
+    }
+}
+
+double percentileMs(const vector<uint32_t>& sortedUs, double q) {
+    if (sortedUs.empty()) return 0;
+    size_t i = min(sortedUs.size() - 1, static_cast<size_t>(q * sortedUs.size()));
+    return sortedUs[i] / 1000.0;
+}
+
+bool parseAddress(const string& address, string& host, int& port) {
+    size_t colon = address.rfind(':');
+    if (colon == string::npos || colon == 0) return false;
+    host = address.substr(0, colon);
+    port = atoi(address.c_str() + colon + 1);
+    return port > 0;
+}
+
+int main(int argc, char** argv) {
+    LoadConfig cfg;
+    bool valid = true;
+    for (int a = 1; a < argc && valid; ++a) {
+        string arg = argv[a];
+        auto valueOf = [&](const char* name) -> const char* {
+            size_t n = strlen(name);
+            return arg.compare(0, n, name) == 0 ? arg.c_str() + n : nullptr;
+        };
+        if (const char* v = valueOf("--server=")) valid = parseAddress(v, cfg.serverHost, cfg.serverPort);
+        else if (const char* v = valueOf("--rooms=")) cfg.rooms = atoi(v);
+        else if (const char* v = valueOf("--players=")) cfg.players = atoi(v);
+        else if (const char* v = valueOf("--duration=")) cfg.duration = atof(v);
+        else if (const char* v = valueOf("--ramp=")) cfg.ramp = atof(v);
+        else if (const char* v = valueOf("--turn-rate=")) cfg.turnRate = atof(v);
+        else if (const char* v = valueOf("--end-rate=")) cfg.endRate = atof(v);
+        else if (const char* v = valueOf("--rejoin-delay=")) cfg.rejoinDelay = atof(v);
+        else if (const char* v = valueOf("--senders=")) cfg.senders = atoi(v);
+        else if (const char* v = valueOf("--seed=")) cfg.seed = strtoull(v, nullptr, 10);
+        else if (arg == "--no-mock") cfg.mock = false;
+        else if (const char* v = valueOf("--mock-port=")) cfg.mockPort = atoi(v);
+        else if (const char* v = valueOf("--mock-threads=")) cfg.mockThreads = atoi(v);
+        else if (const char* v = valueOf("--mock-latency-ms=")) cfg.mockLatencyMs = atof(v);
+        else if (const char* v = valueOf("--mock-jitter-ms=")) cfg.mockJitterMs = atof(v);
+        else if (const char* v = valueOf("--mock-fail=")) cfg.mockFailPercent = atof(v);
+        else valid = false;
+    }
+    if (!valid || cfg.rooms <= 0 || cfg.players <= 0 || cfg.senders <= 0 || cfg.mockThreads <= 0 || cfg.duration <= 0 ||
+        cfg.turnRate < 0 || cfg.endRate < 0) {
+        cerr << "Usage: glowrace_loadgen [--server=HOST:PORT] [--rooms=N] [--players=N] [--duration=S] [--ramp=S]\n"
+                "                        [--turn-rate=R] [--end-rate=R] [--rejoin-delay=S] [--senders=N] [--seed=N]\n"
+                "                        [--no-mock | --mock-port=N --mock-threads=N --mock-latency-ms=MS\n"
+                "                         --mock-jitter-ms=MS --mock-fail=PCT]"
+             << endl;
+        return 2;
+    }
+    cfg.senders = min(cfg.senders, cfg.players);
+
+    MockBackend backend(cfg);
+    if (cfg.mock) {
+        if (!backend.start()) {
+            cerr << "Failed to bind the mock backend to port " << cfg.mockPort << endl;
+            return 1;
+        }
+        cerr << "Mock backend on port " << cfg.mockPort << "; run the server with GLOWRACE_BACKEND=127.0.0.1:" << cfg.mockPort << endl;
+    }
+
+    // The server may still be starting
+    Client probe(cfg.serverHost, cfg.serverPort);
+    probe.set_connection_timeout(1);
+    bool up = false;
+    for (int attempt = 0; attempt < 30 && !up; ++attempt) {
+        auto res = probe.Get("/");
+        up = res && res->status == 200;
+        if (!up) this_thread::sleep_for(chrono::milliseconds(500));
+    }
+    if (!up) {
+        cerr << "No server at " << cfg.serverHost << ":" << cfg.serverPort << endl;
+        backend.stop();
+        return 1;
+    }
+
+    cerr << cfg.players << " players in " << cfg.rooms << " rooms for " << cfg.duration << " s from " << cfg.senders
+         << " senders" << endl;
+    auto begin = chrono::steady_clock::now();
+    vector<SenderStats> stats(static_cast<size_t>(cfg.senders));
+    vector<thread> senders;
+    for (int i = 0; i < cfg.senders; ++i) {
+        senders.emplace_back(runSender, cref(cfg), i, begin, ref(stats[static_cast<size_t>(i)]));
+    }
+    atomic<bool> finished{false};
+    thread progress([&] {
+        auto next = begin;
+        while (!finished) {
+            next += chrono::seconds(5);
+            while (!finished && chrono::steady_clock::now() < next) this_thread::sleep_for(chrono::milliseconds(100));
+            if (finished) break;
+            cerr << chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - begin).count() << " s: "
+                 << sentTotal << " actions, " << unavailableTotal << " 503s, " << backend.stateRequests << " frames" << endl;
+        }
+    });
+    for (thread& sender : senders) sender.join();
+    finished = true;
+    progress.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    SenderStats total;
+    for (SenderStats& s : stats) {
+        total.latencyUs.insert(total.latencyUs.end(), s.latencyUs.begin(), s.latencyUs.end());
+        for (int k = 0; k < 3; ++k) total.sent[k] += s.sent[k];
+        total.ok += s.ok;
+        total.badRequest += s.badRequest;
+        total.unavailable += s.unavailable;
+        total.otherErrors += s.otherErrors;
+        total.noResponse += s.noResponse;
+    }
+    sort(total.latencyUs.begin(), total.latencyUs.end());
+    uint64_t sent = total.sent[0] + total.sent[1] + total.sent[2];
+
+    printf("duration: %.1f s\n", elapsed);
+    printf("actions: %llu (%.1f/s): %llu addPlayer, %llu changeDirection, %llu endGame\n",
+           static_cast<unsigned long long>(sent), sent / elapsed, static_cast<unsigned long long>(total.sent[0]),
+           static_cast<unsigned long long>(total.sent[1]), static_cast<unsigned long long>(total.sent[2]));
+    printf("update latency ms: p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n", percentileMs(total.latencyUs, 0.5),
+           percentileMs(total.latencyUs, 0.9), percentileMs(total.latencyUs, 0.99), percentileMs(total.latencyUs, 0.999),
+           total.latencyUs.empty() ? 0.0 : total.latencyUs.back() / 1000.0);
+    printf("responses: %llu ok, %llu 400, %llu 503 (%.2f%%), %llu other errors, %llu no response\n",
+           static_cast<unsigned long long>(total.ok), static_cast<unsigned long long>(total.badRequest),
+           static_cast<unsigned long long>(total.unavailable), sent ? 100.0 * total.unavailable / sent : 0.0,
+           static_cast<unsigned long long>(total.otherErrors), static_cast<unsigned long long>(total.noResponse));
+    if (!cfg.mock) return 0;
+
+    // Ticks each room advanced over the span it was seen ticking; the loop
+    // aims for 5 a second and parks a room nobody is alive in
+    vector<double> rates;
+    uint64_t ticks = 0, frames = 0;
+    for (const MockBackend::RoomFrames& room : backend.roomFrames()) {
+        ticks += room.ticks;
+        frames += room.tickFrames;
+        double span = chrono::duration<double>(room.latest - room.first).count();
+        if (span >= 1) rates.push_back(room.ticks / span);
+    }
+    sort(rates.begin(), rates.end());
+    double mean = 0;
+    for (double rate : rates) mean += rate;
+    if (!rates.empty()) mean /= rates.size();
+    printf("tick rate per room: mean %.2f/s, p10 %.2f/s, min %.2f/s over %zu rooms (target 5/s)\n", mean,
+           rates.empty() ? 0.0 : rates[rates.size() / 10], rates.empty() ? 0.0 : rates.front(), rates.size());
+    // A tick whose frame failed to post still advances the count
+    printf("frames: %llu tick frames for %llu ticks, %llu /state, %llu /load_state, %llu /check_reset, %llu injected failures\n",
+           static_cast<unsigned long long>(frames), static_cast<unsigned long long>(ticks),
+           static_cast<unsigned long long>(backend.stateRequests.load()),
+           static_cast<unsigned long long>(backend.loadRequests.load()),
+           static_cast<unsigned long long>(backend.checkRequests.load()),
+           static_cast<unsigned long long>(backend.injectedFailures.load()));
+    backend.stop();
+    return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "metrics.h"
+#include "trace.h"
+#include <chrono>
+#include <mutex>
+
+// The game lock held by one critical section, recording how long the
+// section waited for it and how long it held it under the section's site:
+//
+//   ProfiledLock lock(gameStateMutex, metrics::LockSite::Tick, chrono::seconds(10));
+//   if (!lock) { ...timed out... }
+//
+// An uncontended acquisition costs one try_lock and two clock reads. Timed
+// out attempts count against the site's timeouts, and their wait is
+// recorded too, so the wait histograms show the whole tail. With tracing on,
+// contended waits also appear in the timeline as lock_wait spans.
+class ProfiledLock {
+public:
+    // Gives up after timeout; check the lock before using what it guards
+    ProfiledLock(std::timed_mutex& mutex, metrics::LockSite site, std::chrono::steady_clock::duration timeout)
+        : mutex(mutex), site(site) {
+        auto start = std::chrono::steady_clock::now();
+        bool contended = !mutex.try_lock();
+        owned = !contended || mutex.try_lock_for(timeout);
+        acquired = contended ? std::chrono::steady_clock::now() : start;
+        recordWait(start, contended);
+        if (!owned) metrics::addLockTimeout(site);
+    }
+
+    // Waits as long as it takes
+    ProfiledLock(std::timed_mutex& mutex, metrics::LockSite site) : mutex(mutex), site(site), owned(true) {
+        auto start = std::chrono::steady_clock::now();
+        bool contended = !mutex.try_lock();
+        if (contended) mutex.lock();
+        acquired = contended ? std::chrono::steady_clock::now() : start;
+        recordWait(start, contended);
+    }
+
+    ~ProfiledLock() {
+        if (owned) unlock();
+    }
+
+    ProfiledLock(const ProfiledLock&) = delete;
+    ProfiledLock& operator=(const ProfiledLock&) = delete;
+
+    explicit operator bool() const { return owned; }
+
+    // How long acquiring took, or how long it tried before timing out
+    std::chrono::steady_clock::duration waited() const { return wait; }
+
+    void unlock() {
+        metrics::observeLockHold(site, std::chrono::steady_clock::now() - acquired);
+        owned = false;
+        mutex.unlock();
+    }
+
+private:
+    void recordWait(std::chrono::steady_clock::time_point start, bool contended) {
+        wait = acquired - start;
+        metrics::observeLockWait(site, wait, contended);
+        if (contended && glowtrace::enabled()) glowtrace::record("lock_wait", start, acquired, metrics::lockSiteName(site));
+    }
+
+    std::timed_mutex& mutex;
+    metrics::LockSite site;
+    bool owned;
+    std::chrono::steady_clock::time_point acquired;
+    std::chrono::steady_clock::duration wait;
+};
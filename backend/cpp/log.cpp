@@ -0,0 +1,268 @@
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace glowlog {
+
+namespace {
+
+// Bytes a thread can have waiting for the writer. Room loops log a handful
+// of lines per game at info, and the writer drains every few milliseconds.
+constexpr size_t kRingBytes = 16 * 1024;
+constexpr auto kDrainEvery = chrono::milliseconds(5);
+
+struct RecordHeader {
+    uint32_t length;
+    Level level;
+    int64_t timeNs; // System clock
+};
+
+// Single producer (the owning thread), single consumer (the writer). head
+// and tail count bytes ever written and read, so their difference is the
+// fill and their values mod kRingBytes the offsets.
+struct Ring {
+    unique_ptr<char[]> data{new char[kRingBytes]};
+    atomic<uint64_t> head{0};
+    atomic<uint64_t> tail{0};
+    atomic<bool> retired{false}; // Owning thread exited; freed once drained
+
+    void copyIn(uint64_t at, const void* from, size_t size) {
+        size_t offset = at % kRingBytes;
+        size_t first = min(size, kRingBytes - offset);
+        memcpy(data.get() + offset, from, first);
+        memcpy(data.get(), static_cast<const char*>(from) + first, size - first);
+    }
+
+    void copyOut(uint64_t at, void* to, size_t size) const {
+        size_t offset = at % kRingBytes;
+        size_t first = min(size, kRingBytes - offset);
+        memcpy(to, data.get() + offset, first);
+        memcpy(static_cast<char*>(to) + first, data.get(), size - first);
+    }
+
+    bool push(Level level, int64_t timeNs, string_view text) {
+        RecordHeader header{static_cast<uint32_t>(text.size()), level, timeNs};
+        uint64_t at = head.load(memory_order_relaxed);
+        if (kRingBytes - (at - tail.load(memory_order_acquire)) < sizeof(header) + text.size()) return false;
+        copyIn(at, &header, sizeof(header));
+        copyIn(at + sizeof(header), text.data(), text.size());
+        head.store(at + sizeof(header) + text.size(), memory_order_release);
+        return true;
+    }
+};
+
+struct Entry {
+    int64_t timeNs;
+    Level level;
+    string text;
+};
+
+atomic<Level> minLevel{Level::Trace};
+atomic<uint64_t> dropped{0};
+
+mutex ringsMutex;
+vector<shared_ptr<Ring>> rings;
+
+mutex flushMutex;
+condition_variable flushWanted, flushDone;
+uint64_t flushRequested = 0, flushCompleted = 0;
+
+once_flag writerStarted;
+
+const char* levelName(Level level) {
+    switch (level) {
+        case Level::Trace: return "TRACE";
+        case Level::Debug: return "DEBUG";
+        case Level::Info: return "INFO ";
+        case Level::Warn: return "WARN ";
+        case Level::Error: return "ERROR";
+        case Level::Off: break;
+    }
+    return "?    ";
+}
+
+// Moves everything waiting in the rings into entries, freeing the rings of
+// threads that have exited
+void drain(vector<Entry>& entries) {
+    vector<shared_ptr<Ring>> snapshot;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+    for (const auto& ring : snapshot) {
+        bool retired = ring->retired.load(memory_order_acquire);
+        uint64_t at = ring->tail.load(memory_order_relaxed);
+        uint64_t end = ring->head.load(memory_order_acquire);
+        while (at < end) {
+            RecordHeader header;
+            ring->copyOut(at, &header, sizeof(header));
+            Entry entry{header.timeNs, header.level, string(header.length, '\0')};
+            ring->copyOut(at + sizeof(header), entry.text.data(), header.length);
+            entries.push_back(move(entry));
+            at += sizeof(header) + header.length;
+        }
+        ring->tail.store(at, memory_order_release);
+        if (retired) {
+            lock_guard<mutex> lock(ringsMutex);
+            rings.erase(remove(rings.begin(), rings.end(), ring), rings.end());
+        }
+    }
+}
+
+void write(vector<Entry>& entries) {
+    // Each ring is in order already; this interleaves the threads
+    stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.timeNs < b.timeNs; });
+    string out;
+    for (const Entry& entry : entries) {
+        time_t seconds = static_cast<time_t>(entry.timeNs / 1000000000);
+        tm parts;
+        localtime_r(&seconds, &parts);
+        char stamp[40];
+        size_t length = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &parts);
+        snprintf(stamp + length, sizeof(stamp) - length, ".%03d ", static_cast<int>(entry.timeNs / 1000000 % 1000));
+        out.append(stamp);
+        out.append(levelName(entry.level));
+        out.push_back(' ');
+        out.append(entry.text);
+        out.push_back('\n');
+    }
+    if (uint64_t lost = dropped.exchange(0)) {
+        out.append("[log] dropped " + to_string(lost) + " lines while the writer was behind\n");
+    }
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    entries.clear();
+}
+
+void writerLoop() {
+    vector<Entry> entries;
+    while (true) {
+        uint64_t requested;
+        {
+            unique_lock<mutex> lock(flushMutex);
+            flushWanted.wait_for(lock, kDrainEvery, [] { return flushRequested != flushCompleted; });
+            requested = flushRequested;
+        }
+        drain(entries);
+        write(entries);
+        {
+            lock_guard<mutex> lock(flushMutex);
+            flushCompleted = requested;
+        }
+        flushDone.notify_all();
+    }
+}
+
+void startWriter() {
+    thread(writerLoop).detach();
+    atexit(flush);
+    at_quick_exit(flush);
+}
+
+// The calling thread's ring, registered on first use and retired when the
+// thread exits
+struct ThreadRing {
+    shared_ptr<Ring> ring;
+
+    ThreadRing() : ring(make_shared<Ring>()) {
+        call_once(writerStarted, startWriter);
+        lock_guard<mutex> lock(ringsMutex);
+        rings.push_back(ring);
+    }
+    ~ThreadRing() { ring->retired.store(true, memory_order_release); }
+};
+
+struct ThreadBuffer {
+    string text;
+    bool busy = false;
+};
+
+Ring& threadRing() {
+    thread_local ThreadRing local;
+    return *local.ring;
+}
+
+ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer buffer;
+    return buffer;
+}
+
+int64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void setMinLevel(Level level) {
+    minLevel.store(level, memory_order_relaxed);
+}
+
+bool enabled(Level level) {
+    return level >= minLevel.load(memory_order_relaxed);
+}
+
+void flush() {
+    unique_lock<mutex> lock(flushMutex);
+    uint64_t ticket = ++flushRequested;
+    flushWanted.notify_one();
+    // Bounded, in case the writer never started or is wedged on stdout
+    flushDone.wait_for(lock, chrono::seconds(2), [ticket] { return flushCompleted >= ticket; });
+}
+
+bool Sampler::admit(uint64_t& held) {
+    int64_t second = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t current = window.load(memory_order_relaxed);
+    if (current != second && window.compare_exchange_strong(current, second)) used.store(0);
+    if (used.fetch_add(1) < perSecond) {
+        held = skipped.exchange(0);
+        return true;
+    }
+    skipped.fetch_add(1);
+    return false;
+}
+
+Line::Line(Level level, uint64_t held) : level(level), held(held) {
+    ThreadBuffer& buffer = threadBuffer();
+    shared = !buffer.busy;
+    text = shared ? &buffer.text : &own;
+    buffer.busy = true;
+    text->clear();
+}
+
+Line::~Line() {
+    if (held > 0) *this << " (" << held << " similar lines held back)";
+    // Longer than the ring can ever hold; keep the start of it
+    size_t limit = kRingBytes / 2;
+    if (text->size() > limit) {
+        text->resize(limit - 16);
+        text->append(" ...[truncated]");
+    }
+    if (!threadRing().push(level, nowNs(), *text)) dropped.fetch_add(1, memory_order_relaxed);
+    if (shared) threadBuffer().busy = false;
+}
+
+Line& Line::operator<<(string_view value) {
+    text->append(value.data(), value.size());
+    return *this;
+}
+
+Line& Line::operator<<(double value) {
+    char digits[32];
+    int length = snprintf(digits, sizeof(digits), "%g", value); // cout's default formatting
+    return *this << string_view(digits, static_cast<size_t>(max(0, length)));
+}
+
+} // namespace glowlog
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Leveled, asynchronous logging for the server and the simulation core.
+//
+//   GLOWRACE_LOG(Info) << "Parked game loop for room " << roomId;
+//
+// The line is formatted on the calling thread into a reused thread-local
+// buffer and copied into that thread's ring when the statement ends; a
+// background writer drains every ring to stdout in timestamp order. Nothing
+// takes a lock or flushes on the logging thread. A full ring drops the line
+// instead of blocking, and the writer reports how many were dropped.
+//
+// Levels below GLOWRACE_LOG_LEVEL (the CMake cache variable of the same name,
+// "info" by default) compile to nothing, operands included, so trace and
+// debug lines on the tick path cost nothing in a production build.
+//
+//   GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to send game state for room " << roomId;
+//
+// lets at most that many lines a second through from the call site and
+// notes on the next one how many were held back; for lines that can repeat
+// every tick in every room.
+
+#ifndef GLOWRACE_LOG_LEVEL
+#define GLOWRACE_LOG_LEVEL 2
+#endif
+
+namespace glowlog {
+
+enum class Level : uint8_t { Trace, Debug, Info, Warn, Error, Off };
+
+constexpr Level kCompiledLevel = static_cast<Level>(GLOWRACE_LOG_LEVEL);
+
+// Lines below this are also skipped at run time, before any formatting; the
+// tools raise it to keep the core's logging out of their measurements
+void setMinLevel(Level level);
+bool enabled(Level level);
+// Blocks until everything logged so far has been written
+void flush();
+
+// Per call site budget for GLOWRACE_LOG_SAMPLED
+class Sampler {
+public:
+    explicit Sampler(uint32_t perSecond) : perSecond(perSecond) {}
+    // True if a line may go out now, with held set to how many were skipped
+    // since the last one that did
+    bool admit(uint64_t& held);
+
+private:
+    uint32_t perSecond;
+    std::atomic<int64_t> window{0}; // Steady clock second the budget is for
+    std::atomic<uint32_t> used{0};
+    std::atomic<uint64_t> skipped{0};
+};
+
+// One line under construction; queued by its destructor
+class Line {
+public:
+    explicit Line(Level level, uint64_t held = 0);
+    ~Line();
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    Line& operator<<(std::string_view value);
+    Line& operator<<(const char* value) { return *this << std::string_view(value ? value : "(null)"); }
+    Line& operator<<(const std::string& value) { return *this << std::string_view(value); }
+    Line& operator<<(char value) { return *this << std::string_view(&value, 1); }
+    Line& operator<<(bool value) { return *this << (value ? '1' : '0'); } // As cout prints it
+    Line& operator<<(double value);
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    Line& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, static_cast<size_t>(result.ptr - digits));
+    }
+
+private:
+    Level level;
+    uint64_t held;
+    bool shared; // Formatting into the thread's buffer rather than own
+    std::string own; // Only for a line logged while another is being built
+    std::string* text;
+};
+
+} // namespace glowlog
+
+// Both are a for loop that runs its body at most once, so the macro is one
+// statement with no else of its own: it cannot capture an else written after
+// it, and is safe in an unbraced if. Below kCompiledLevel the condition is a
+// constant false and the line is dropped at compile time.
+#define GLOWRACE_LOG(level)                                                                 \
+    for (bool glowlogOn = ::glowlog::Level::level >= ::glowlog::kCompiledLevel &&           \
+                          ::glowlog::enabled(::glowlog::Level::level);                      \
+         glowlogOn; glowlogOn = false)                                                      \
+        ::glowlog::Line(::glowlog::Level::level)
+
+#define GLOWRACE_LOG_SAMPLED(level, perSecond)                                              \
+    for (uint64_t glowlogHeld = 0,                                                          \
+                  glowlogOn = ::glowlog::Level::level >= ::glowlog::kCompiledLevel &&       \
+                              ::glowlog::enabled(::glowlog::Level::level) &&                \
+                              []() -> ::glowlog::Sampler& {                                 \
+                                  static ::glowlog::Sampler sampler(perSecond);             \
+                                  return sampler;                                           \
+                              }().admit(glowlogHeld);                                       \
+         glowlogOn; glowlogOn = 0)                                                          \
+        ::glowlog::Line(::glowlog::Level::level, glowlogHeld)
@@ -0,0 +1,340 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace metrics {
+
+namespace {
+
+constexpr size_t kCounters = static_cast<size_t>(Counter::Count);
+constexpr size_t kHistograms = static_cast<size_t>(Histogram::Count);
+constexpr size_t kLockSites = static_cast<size_t>(LockSite::Count);
+
+// 1 us, an uncontended lock or a small tick, up to the 10 s lock timeout
+constexpr double kBounds[] = {0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005, 0.0001, 0.00025,
+                              0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                              0.25, 0.5, 1, 2.5, 5, 10};
+static_assert(sizeof(kBounds) / sizeof(kBounds[0]) == kBuckets, "kBuckets matches the bounds");
+constexpr uint64_t kBoundsNs[kBuckets] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+                                          500000, 1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000,
+                                          250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000};
+
+const char* const kLockSiteNames[] = {"update", "reset", "create_room", "memory", "metrics",
+                                     "game_loop", "tick", "publish", "send_state", "reset_worker",
+                                     "monitor", "checkpoint", "replication", "handoff", "latency",
+                                     "rooms", "flight", "evict"};
+static_assert(sizeof(kLockSiteNames) / sizeof(kLockSiteNames[0]) == kLockSites, "a name for every LockSite");
+
+struct Series {
+    const char* family;
+    const char* help;
+    const char* labels;
+};
+
+const Series kCounterSeries[kCounters] = {
+    {"glowrace_backend_errors_total", "Requests to FastAPI that failed or timed out", "endpoint=\"/state\""},
+    {"glowrace_backend_errors_total", "", "endpoint=\"/load_state\""},
+    {"glowrace_room_throttles_total", "Times a room went over its tick CPU budget and was slowed down", ""},
+    {"glowrace_room_evictions_total", "Rooms whose game was wiped after staying over their CPU budget", ""},
+};
+
+const Series kHistogramSeries[kHistograms] = {
+    {"glowrace_tick_seconds", "Time to simulate one room tick, with the game lock held", ""},
+    {"glowrace_tick_lateness_seconds", "How far past its 200 ms cadence each room tick started", ""},
+    {"glowrace_update_seconds", "Time /update spent in each phase", "phase=\"parse\""},
+    {"glowrace_update_seconds", "", "phase=\"lock_wait\""},
+    {"glowrace_update_seconds", "", "phase=\"apply\""},
+    {"glowrace_update_seconds", "", "phase=\"respond\""},
+    {"glowrace_backend_request_seconds", "Latency of requests to FastAPI, failed ones included", "endpoint=\"/state\""},
+    {"glowrace_backend_request_seconds", "", "endpoint=\"/load_state\""},
+    {"glowrace_input_latency_seconds",
+     "Time from an action's arrival to the first published frame that moved with it, by segment; forward is FastAPI to here",
+     "segment=\"forward\""},
+    {"glowrace_input_latency_seconds", "", "segment=\"apply\""},
+    {"glowrace_input_latency_seconds", "", "segment=\"tick_wait\""},
+    {"glowrace_input_latency_seconds", "", "segment=\"tick\""},
+    {"glowrace_input_latency_seconds", "", "segment=\"publish\""},
+    {"glowrace_input_latency_seconds", "", "segment=\"total\""},
+};
+
+double quantileSeconds(const uint64_t* buckets, uint64_t maxNs, double q) {
+    uint64_t total = 0, cumulative = 0;
+    for (size_t b = 0; b <= kBuckets; b++) total += buckets[b];
+    if (total == 0) return 0;
+    double maxSeconds = static_cast<double>(maxNs) / 1e9;
+    for (size_t b = 0; b < kBuckets; b++) {
+        cumulative += buckets[b];
+        if (static_cast<double>(cumulative) >= q * static_cast<double>(total)) return min(kBounds[b], maxSeconds);
+    }
+    return maxSeconds;
+}
+
+// Histograms in a shard are written only by the shard's thread
+struct alignas(64) Shard {
+    atomic<uint64_t> counters[kCounters] = {};
+    Distribution histograms[kHistograms];
+    Distribution lockWait[kLockSites];
+    Distribution lockHold[kLockSites];
+    atomic<uint64_t> lockContended[kLockSites] = {};
+    atomic<uint64_t> lockTimeouts[kLockSites] = {};
+};
+
+// One histogram summed over the shards
+struct Sums {
+    uint64_t buckets[kBuckets + 1] = {};
+    uint64_t sumNs = 0;
+    uint64_t maxNs = 0;
+
+    void add(const Distribution& distribution) {
+        for (size_t b = 0; b <= kBuckets; b++) buckets[b] += distribution.buckets[b].load(memory_order_relaxed);
+        sumNs += distribution.sumNs.load(memory_order_relaxed);
+        maxNs = max(maxNs, distribution.maxNs.load(memory_order_relaxed));
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (uint64_t bucket : buckets) total += bucket;
+        return total;
+    }
+
+    double quantileSeconds(double q) const { return metrics::quantileSeconds(buckets, maxNs, q); }
+};
+
+struct Totals {
+    uint64_t counters[kCounters] = {};
+    Sums histograms[kHistograms];
+    Sums lockWait[kLockSites];
+    Sums lockHold[kLockSites];
+    uint64_t lockContended[kLockSites] = {};
+    uint64_t lockTimeouts[kLockSites] = {};
+
+    void add(const Shard& shard) {
+        for (size_t i = 0; i < kCounters; i++) counters[i] += shard.counters[i].load(memory_order_relaxed);
+        for (size_t h = 0; h < kHistograms; h++) histograms[h].add(shard.histograms[h]);
+        for (size_t s = 0; s < kLockSites; s++) {
+            lockWait[s].add(shard.lockWait[s]);
+            lockHold[s].add(shard.lockHold[s]);
+            lockContended[s] += shard.lockContended[s].load(memory_order_relaxed);
+            lockTimeouts[s] += shard.lockTimeouts[s].load(memory_order_relaxed);
+        }
+    }
+};
+
+mutex registryMutex;
+vector<Shard*> shards;
+Totals retired; // Shards of threads that have exited
+
+// The calling thread's shard, registered on first use and folded into
+// retired when the thread exits
+struct ThreadShard {
+    Shard shard;
+
+    ThreadShard() {
+        lock_guard<mutex> lock(registryMutex);
+        shards.push_back(&shard);
+    }
+    ~ThreadShard() {
+        lock_guard<mutex> lock(registryMutex);
+        retired.add(shard);
+        shards.erase(find(shards.begin(), shards.end(), &shard));
+    }
+};
+
+Shard& threadShard() {
+    thread_local ThreadShard local;
+    return local.shard;
+}
+
+Totals collect() {
+    Totals totals;
+    lock_guard<mutex> lock(registryMutex);
+    totals = retired;
+    for (const Shard* shard : shards) totals.add(*shard);
+    return totals;
+}
+
+void bump(atomic<uint64_t>& value, uint64_t n) {
+    value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void appendNumber(string& out, double value) {
+    char digits[32];
+    // Counts exactly, however large; fractions to nanosecond precision
+    bool whole = value == static_cast<double>(static_cast<int64_t>(value));
+    int length = snprintf(digits, sizeof(digits), whole ? "%.0f" : "%.9g", value);
+    out.append(digits, static_cast<size_t>(max(0, length)));
+}
+
+void appendHeader(string& out, const char* name, const char* help, const char* type) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void appendSample(string& out, const char* name, const char* suffix, const char* labels, const char* le, double value) {
+    out.append(name).append(suffix);
+    if (*labels || le) {
+        out.push_back('{');
+        out.append(labels);
+        if (le) out.append(*labels ? ",le=\"" : "le=\"").append(le).push_back('"');
+        out.push_back('}');
+    }
+    out.push_back(' ');
+    appendNumber(out, value);
+    out.push_back('\n');
+}
+
+void appendHistogramSamples(string& out, const char* name, const char* labels, const double* bounds,
+                            const uint64_t* buckets, size_t count, double sum) {
+    uint64_t cumulative = 0;
+    char le[32];
+    for (size_t b = 0; b < count; b++) {
+        cumulative += buckets[b];
+        snprintf(le, sizeof(le), "%g", bounds[b]);
+        appendSample(out, name, "_bucket", labels, le, static_cast<double>(cumulative));
+    }
+    cumulative += buckets[count];
+    appendSample(out, name, "_bucket", labels, "+Inf", static_cast<double>(cumulative));
+    appendSample(out, name, "_sum", labels, nullptr, sum);
+    appendSample(out, name, "_count", labels, nullptr, static_cast<double>(cumulative));
+}
+
+void appendSeriesHistogram(string& out, const char* name, const string& labels, const Sums& sums) {
+    appendHistogramSamples(out, name, labels.c_str(), kBounds, sums.buckets, kBuckets,
+                           static_cast<double>(sums.sumNs) / 1e9);
+}
+
+string siteLabel(size_t site) {
+    return string("site=\"") + kLockSiteNames[site] + "\"";
+}
+
+} // namespace
+
+void Distribution::observe(chrono::steady_clock::duration elapsed) {
+    uint64_t ns = static_cast<uint64_t>(max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+    size_t bucket = 0;
+    while (bucket < kBuckets && ns > kBoundsNs[bucket]) bucket++;
+    bump(buckets[bucket], 1);
+    bump(sumNs, ns);
+    if (ns > maxNs.load(memory_order_relaxed)) maxNs.store(ns, memory_order_relaxed);
+}
+
+uint64_t Distribution::count() const {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets) total += bucket.load(memory_order_relaxed);
+    return total;
+}
+
+double Distribution::quantileSeconds(double q) const {
+    uint64_t counts[kBuckets + 1];
+    for (size_t b = 0; b <= kBuckets; b++) counts[b] = buckets[b].load(memory_order_relaxed);
+    return metrics::quantileSeconds(counts, maxNs.load(memory_order_relaxed), q);
+}
+
+const char* lockSiteName(LockSite site) {
+    return kLockSiteNames[static_cast<size_t>(site)];
+}
+
+void add(Counter counter, uint64_t n) {
+    bump(threadShard().counters[static_cast<size_t>(counter)], n);
+}
+
+void observe(Histogram histogram, chrono::steady_clock::duration elapsed) {
+    threadShard().histograms[static_cast<size_t>(histogram)].observe(elapsed);
+}
+
+void observeLockWait(LockSite site, chrono::steady_clock::duration wait, bool contended) {
+    Shard& shard = threadShard();
+    shard.lockWait[static_cast<size_t>(site)].observe(wait);
+    if (contended) bump(shard.lockContended[static_cast<size_t>(site)], 1);
+}
+
+void observeLockHold(LockSite site, chrono::steady_clock::duration hold) {
+    threadShard().lockHold[static_cast<size_t>(site)].observe(hold);
+}
+
+void addLockTimeout(LockSite site) {
+    bump(threadShard().lockTimeouts[static_cast<size_t>(site)], 1);
+}
+
+vector<LockSiteStats> lockSiteStats() {
+    Totals totals = collect();
+    vector<LockSiteStats> stats;
+    for (size_t s = 0; s < kLockSites; s++) {
+        const Sums& wait = totals.lockWait[s];
+        const Sums& hold = totals.lockHold[s];
+        LockSiteStats site;
+        site.site = static_cast<LockSite>(s);
+        site.attempts = wait.count();
+        site.contended = totals.lockContended[s];
+        site.timeouts = totals.lockTimeouts[s];
+        site.waitTotalMs = static_cast<double>(wait.sumNs) / 1e6;
+        site.waitP99Ms = wait.quantileSeconds(0.99) * 1e3;
+        site.waitMaxMs = static_cast<double>(wait.maxNs) / 1e6;
+        site.holdTotalMs = static_cast<double>(hold.sumNs) / 1e6;
+        site.holdP99Ms = hold.quantileSeconds(0.99) * 1e3;
+        site.holdMaxMs = static_cast<double>(hold.maxNs) / 1e6;
+        stats.push_back(site);
+    }
+    stable_sort(stats.begin(), stats.end(),
+                [](const LockSiteStats& a, const LockSiteStats& b) { return a.waitTotalMs > b.waitTotalMs; });
+    return stats;
+}
+
+void render(string& out) {
+    Totals totals = collect();
+    const char* family = nullptr;
+    for (size_t i = 0; i < kCounters; i++) {
+        const Series& series = kCounterSeries[i];
+        if (!family || string_view(family) != series.family) appendHeader(out, series.family, series.help, "counter");
+        family = series.family;
+        appendSample(out, series.family, "", series.labels, nullptr, static_cast<double>(totals.counters[i]));
+    }
+    appendHeader(out, "glowrace_lock_contended_total", "Game lock acquisitions that found the lock taken", "counter");
+    for (size_t s = 0; s < kLockSites; s++) {
+        appendSample(out, "glowrace_lock_contended_total", "", siteLabel(s).c_str(), nullptr,
+                     static_cast<double>(totals.lockContended[s]));
+    }
+    appendHeader(out, "glowrace_mutex_timeouts_total",
+                 "Times the game lock was not free in time; the update, reset, create_room and memory sites answered 503",
+                 "counter");
+    for (size_t s = 0; s < kLockSites; s++) {
+        appendSample(out, "glowrace_mutex_timeouts_total", "", siteLabel(s).c_str(), nullptr,
+                     static_cast<double>(totals.lockTimeouts[s]));
+    }
+
+    family = nullptr;
+    for (size_t h = 0; h < kHistograms; h++) {
+        const Series& series = kHistogramSeries[h];
+        if (!family || string_view(family) != series.family) appendHeader(out, series.family, series.help, "histogram");
+        family = series.family;
+        appendSeriesHistogram(out, series.family, series.labels, totals.histograms[h]);
+    }
+    appendHeader(out, "glowrace_lock_wait_seconds", "Time spent waiting for the game lock, timed out attempts included",
+                 "histogram");
+    for (size_t s = 0; s < kLockSites; s++) {
+        appendSeriesHistogram(out, "glowrace_lock_wait_seconds", siteLabel(s), totals.lockWait[s]);
+    }
+    appendHeader(out, "glowrace_lock_hold_seconds", "Time the game lock was held", "histogram");
+    for (size_t s = 0; s < kLockSites; s++) {
+        appendSeriesHistogram(out, "glowrace_lock_hold_seconds", siteLabel(s), totals.lockHold[s]);
+    }
+}
+
+void appendGauge(string& out, const char* name, const char* help, double value) {
+    appendHeader(out, name, help, "gauge");
+    appendSample(out, name, "", "", nullptr, value);
+}
+
+void appendHistogram(string& out, const char* name, const char* help, const double* bounds, const uint64_t* buckets,
+                     size_t count, double sum) {
+    appendHeader(out, name, help, "histogram");
+    appendHistogramSamples(out, name, "", bounds, buckets, count, sum);
+}
+
+} // namespace metrics
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counters and latency histograms for GET /metrics, in the Prometheus text
+// exposition format.
+//
+//   auto start = chrono::steady_clock::now();
+//   ...
+//   metrics::observe(metrics::Histogram::TickSeconds, chrono::steady_clock::now() - start);
+//   metrics::add(metrics::Counter::StateErrors);
+//
+// Every thread records into its own shard, which only that thread writes,
+// so recording is a few relaxed loads and stores with no lock and no shared
+// cache line. A scrape adds the shards up; a thread's shard is folded into
+// a running total when it exits, so nothing goes backwards.
+
+namespace metrics {
+
+// Each is one series; series of the same family are kept together
+enum class Counter : uint8_t {
+    StateErrors, // glowrace_backend_errors_total
+    LoadStateErrors,
+    RoomThrottles, // glowrace_room_throttles_total
+    RoomEvictions, // glowrace_room_evictions_total
+    Count
+};
+
+enum class Histogram : uint8_t {
+    TickSeconds, // glowrace_tick_seconds: simulating one tick, under the lock
+    TickLatenessSeconds, // glowrace_tick_lateness_seconds: past the 200 ms cadence
+    UpdateParseSeconds, // glowrace_update_seconds, by phase
+    UpdateLockWaitSeconds,
+    UpdateApplySeconds,
+    UpdateRespondSeconds,
+    StateSeconds, // glowrace_backend_request_seconds, by endpoint
+    LoadStateSeconds,
+    InputForwardSeconds, // glowrace_input_latency_seconds, by segment; see Room::pendingInputs
+    InputApplySeconds,
+    InputTickWaitSeconds,
+    InputTickSeconds,
+    InputPublishSeconds,
+    InputTotalSeconds,
+    Count
+};
+
+// Critical sections on the game lock, recorded by ProfiledLock
+// (lock_profile.h) as glowrace_lock_wait_seconds, glowrace_lock_hold_seconds,
+// glowrace_lock_contended_total and glowrace_mutex_timeouts_total by site
+enum class LockSite : uint8_t {
+    Update,
+    Reset,
+    CreateRoom,
+    Memory,
+    Metrics,
+    GameLoop,
+    Tick,
+    Publish,
+    SendState,
+    ResetWorker,
+    Monitor,
+    Checkpoint,
+    Replication,
+    Handoff,
+    Latency,
+    Rooms,
+    Flight,
+    Evict,
+    Count
+};
+
+const char* lockSiteName(LockSite site);
+
+// Buckets every histogram here shares, from 1 us up to the 10 s lock timeout
+constexpr size_t kBuckets = 22;
+
+// A histogram with the shared buckets that only one thread writes at a time
+// and any thread may read; for figures kept per room rather than per thread
+struct Distribution {
+    std::atomic<uint64_t> buckets[kBuckets + 1] = {}; // The last is +Inf
+    std::atomic<uint64_t> sumNs{0};
+    std::atomic<uint64_t> maxNs{0};
+
+    void observe(std::chrono::steady_clock::duration elapsed);
+    uint64_t count() const;
+    // The upper bound of the bucket the quantile falls in, capped at the maximum
+    double quantileSeconds(double q) const;
+};
+
+void add(Counter counter, uint64_t n = 1);
+void observe(Histogram histogram, std::chrono::steady_clock::duration elapsed);
+// Every attempt, timed out ones included; contended if the lock was not
+// free on the first try
+void observeLockWait(LockSite site, std::chrono::steady_clock::duration wait, bool contended);
+void observeLockHold(LockSite site, std::chrono::steady_clock::duration hold);
+void addLockTimeout(LockSite site);
+
+// One site's share of the lock since startup. Percentiles are the upper
+// bound of the histogram bucket they fall in, capped at the maximum.
+struct LockSiteStats {
+    LockSite site;
+    uint64_t attempts = 0;
+    uint64_t contended = 0;
+    uint64_t timeouts = 0;
+    double waitTotalMs = 0, waitP99Ms = 0, waitMaxMs = 0;
+    double holdTotalMs = 0, holdP99Ms = 0, holdMaxMs = 0;
+};
+// Every site, most total wait first
+std::vector<LockSiteStats> lockSiteStats();
+
+// Appends every counter and histogram
+void render(std::string& out);
+
+// For values only known at scrape time
+void appendGauge(std::string& out, const char* name, const char* help, double value);
+// bounds has count entries and buckets count + 1, the last for +Inf; buckets
+// are per bucket, not cumulative
+void appendHistogram(std::string& out, const char* name, const char* help, const double* bounds,
+                     const uint64_t* buckets, size_t count, double sum);
+
+} // namespace metrics
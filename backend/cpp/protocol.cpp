@@ -0,0 +1,51 @@
+#include "protocol.h"
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+void parseLoadedState(const string& body, int gridSize, GameState& state) {
+    auto loaded = json::parse(body);
+    for (const auto& p : loaded.value("players", json::array())) {
+        Direction direction = Direction::Right;
+        parseDirection(p.value("direction", "right"), direction);
+        Position head = wrapToBoard({p.value("row", 0), p.value("col", 0)}, gridSize);
+        size_t i = state.addPlayer(p.value("id", "UnknownPlayer"), p.value("name", "Unknown"), head, direction);
+        // Stored newest first, so append each segment at the back
+        const auto& tail = p.value("tail", json::array());
+        for (auto seg = tail.rbegin(); seg != tail.rend(); ++seg) {
+            state.body(i).pushFront(wrapToBoard({seg->value("row", 0), seg->value("col", 0)}, gridSize));
+        }
+        state.scores[i] = p.value("score", 0);
+        state.alive[i] = p.value("alive", true);
+    }
+
+    for (const auto& glow : loaded.value("glowPoints", json::array())) {
+        state.glowPoints.push_back(wrapToBoard({glow.value("row", 0), glow.value("col", 0)}, gridSize));
+    }
+
+    state.initialPlayerCount = state.playerCount();
+    bool anyAlive = false;
+    for (uint8_t a : state.alive) {
+        if (a) anyAlive = true;
+    }
+    state.gameOver = !anyAlive;
+}
+
+UpdateRequest parseUpdateRequest(const string& body) {
+    json actionJson = json::parse(body);
+    UpdateRequest request;
+    request.actionType = actionJson["action"];
+    request.action.playerId = actionJson["playerId"];
+    request.roomId = actionJson.value("room_id", "");
+    request.receivedAtMs = actionJson.value("received_at_ms", 0.0);
+
+    // Unknown actions and directions still create the room but apply nothing
+    request.valid = parseActionType(request.actionType, request.action.type);
+    if (request.valid && request.action.type == ActionType::AddPlayer) {
+        request.action.name = actionJson.value("name", "Player " + request.action.playerId);
+    } else if (request.valid && request.action.type == ActionType::ChangeDirection) {
+        request.valid = parseDirection(actionJson.value("direction", ""), request.action.direction);
+    }
+    return request;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "game.h"
+#include <string>
+
+// The JSON FastAPI sends the server, parsed outside any lock. Both throw
+// nlohmann::json::exception (json.hpp) on malformed input.
+
+// A /load_state body, built into state, which should be empty and seeded.
+// Coordinates from outside are wrapped onto the board.
+void parseLoadedState(const std::string& body, int gridSize, GameState& state);
+
+struct UpdateRequest {
+    std::string roomId;      // Empty if the request had none
+    std::string actionType;  // As sent, for logs
+    Action action;
+    bool valid = false;      // False for unknown actions and directions
+    double receivedAtMs = 0; // FastAPI's Unix ms stamp, 0 if absent
+};
+
+// A POST /update body
+UpdateRequest parseUpdateRequest(const std::string& body);
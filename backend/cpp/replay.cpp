@@ -0,0 +1,181 @@
+#include "replay.h"
+#include "snapshot.h"
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const char kMagic[4] = {'G', 'R', 'R', 'L'};
+
+void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putText(string& out, const string& text) {
+    putVarint(out, text.size());
+    out.append(text);
+}
+
+struct Reader {
+    const unsigned char* at;
+    const unsigned char* end;
+    bool truncated = false;
+
+    bool has(size_t n) {
+        if (static_cast<size_t>(end - at) < n) truncated = true;
+        return !truncated;
+    }
+    uint8_t byte() { return has(1) ? *at++ : 0; }
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && has(1); shift += 7) {
+            unsigned char b = *at++;
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        truncated = true;
+        return 0;
+    }
+    string text() {
+        uint64_t length = varint();
+        if (!has(length)) return {};
+        string value(reinterpret_cast<const char*>(at), length);
+        at += length;
+        return value;
+    }
+    uint64_t word() {
+        if (!has(8)) return 0;
+        uint64_t value = 0;
+        for (int b = 0; b < 8; ++b) value |= static_cast<uint64_t>(at[b]) << (8 * b);
+        at += 8;
+        return value;
+    }
+};
+
+} // namespace
+
+void ReplayWriter::start() {
+    out.append(kMagic, sizeof(kMagic));
+    out.push_back(static_cast<char>(kReplayVersion));
+}
+
+void ReplayWriter::open(int gridSize, EdgeRule rule) {
+    out.push_back('H');
+    putVarint(out, static_cast<uint64_t>(gridSize));
+    out.push_back(static_cast<char>(rule));
+}
+
+void ReplayWriter::recordState(const GameState& state, int gridSize) {
+    string image;
+    encodeSnapshot(state, gridSize, image);
+    recordImage(image);
+}
+
+void ReplayWriter::recordImage(const string& image) {
+    if (batchCount > 0) flushBatch(false, 0);
+    out.push_back('S');
+    putVarint(out, image.size());
+    out.append(image);
+}
+
+void ReplayWriter::recordAction(const Action& action) {
+    batch.push_back(static_cast<char>(action.type));
+    putText(batch, action.playerId);
+    if (action.type == ActionType::AddPlayer) putText(batch, action.name);
+    if (action.type == ActionType::ChangeDirection) batch.push_back(static_cast<char>(action.direction));
+    batchCount++;
+}
+
+void ReplayWriter::recordTick(uint64_t checksum) {
+    flushBatch(true, checksum);
+}
+
+void ReplayWriter::flushBatch(bool ticked, uint64_t checksum) {
+    out.push_back('T');
+    putVarint(out, batchCount);
+    out.append(batch);
+    out.push_back(ticked ? 1 : 0);
+    if (ticked) {
+        for (int b = 0; b < 8; ++b) out.push_back(static_cast<char>(checksum >> (8 * b)));
+    }
+    batch.clear();
+    batchCount = 0;
+}
+
+string ReplayWriter::take() {
+    string taken;
+    taken.swap(out);
+    return taken;
+}
+
+bool parseReplayLog(const char* data, size_t size, vector<ReplayRecord>& records, string& error) {
+    if (size < sizeof(kMagic) + 1 || memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a replay log";
+        return false;
+    }
+    if (static_cast<uint8_t>(data[sizeof(kMagic)]) != kReplayVersion) {
+        error = "replay log version " + to_string(static_cast<uint8_t>(data[sizeof(kMagic)]));
+        return false;
+    }
+    size_t consumed = 0;
+    return parseReplayRecords(data + sizeof(kMagic) + 1, size - sizeof(kMagic) - 1, records, consumed, error);
+}
+
+bool parseReplayRecords(const char* data, size_t size, vector<ReplayRecord>& records, size_t& consumed, string& error) {
+    Reader in{reinterpret_cast<const unsigned char*>(data), reinterpret_cast<const unsigned char*>(data) + size};
+    consumed = 0;
+    while (in.at < in.end) {
+        ReplayRecord record;
+        char kind = static_cast<char>(in.byte());
+        if (kind == 'H') {
+            record.kind = ReplayRecord::Open;
+            record.gridSize = static_cast<int>(in.varint());
+            uint8_t rule = in.byte();
+            if (rule > static_cast<uint8_t>(EdgeRule::Walls)) {
+                error = "unknown edge rule";
+                return false;
+            }
+            record.rule = static_cast<EdgeRule>(rule);
+        } else if (kind == 'S') {
+            record.kind = ReplayRecord::State;
+            record.image = in.text();
+        } else if (kind == 'T') {
+            record.kind = ReplayRecord::Batch;
+            uint64_t count = in.varint();
+            for (uint64_t a = 0; a < count && !in.truncated; ++a) {
+                Action action;
+                uint8_t type = in.byte();
+                if (type > static_cast<uint8_t>(ActionType::EndGame)) {
+                    error = "unknown action type";
+                    return false;
+                }
+                action.type = static_cast<ActionType>(type);
+                action.playerId = in.text();
+                if (action.type == ActionType::AddPlayer) action.name = in.text();
+                if (action.type == ActionType::ChangeDirection) {
+                    uint8_t direction = in.byte();
+                    if (direction > static_cast<uint8_t>(Direction::Right)) {
+                        error = "unknown direction";
+                        return false;
+                    }
+                    action.direction = static_cast<Direction>(direction);
+                }
+                record.actions.push_back(move(action));
+            }
+            record.ticked = in.byte() != 0;
+            if (record.ticked) record.checksum = in.word();
+        } else {
+            error = "unknown record type";
+            return false;
+        }
+        if (in.truncated) break;
+        records.push_back(move(record));
+        consumed = static_cast<size_t>(in.at - reinterpret_cast<const unsigned char*>(data));
+    }
+    return true;
+}
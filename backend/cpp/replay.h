@@ -0,0 +1,67 @@
+#pragma once
+
+#include "game.h"
+#include <string>
+#include <vector>
+
+// Append-only replay log of one room. Everything that changes a room
+// between ticks is either an action, replayed through applyAction, or a
+// whole new state (a new, reset or resumed room), stored as a snapshot
+// image. Ticks are recorded with the actions applied since the previous one
+// and the state checksum after the tick, so a replay can tell exactly where
+// it diverged.
+//
+//   "GRRL" version
+//   records:
+//     'H' gridSize edgeRule                       each time a process opens the log
+//     'S' length image                            state replaced
+//     'T' actionCount actions ticked [checksum]   batch, then the tick if one ran
+//   action: type playerId [name | direction]
+//
+// Counts and lengths are varints, checksums 8 bytes little-endian.
+
+constexpr uint8_t kReplayVersion = 1;
+
+// Encodes records into a buffer that the owner drains to the log file
+class ReplayWriter {
+public:
+    // The file preamble, for a log that is still empty
+    void start();
+    void open(int gridSize, EdgeRule rule);
+    // Any actions since the last tick are flushed first as their own batch
+    void recordState(const GameState& state, int gridSize);
+    // Same record for a state that is already encoded, e.g. on disk
+    void recordImage(const std::string& image);
+    void recordAction(const Action& action);
+    void recordTick(uint64_t checksum);
+
+    bool empty() const { return out.empty(); }
+    // Hands back the encoded bytes and starts a fresh buffer
+    std::string take();
+
+private:
+    void flushBatch(bool ticked, uint64_t checksum);
+
+    std::string out;
+    std::string batch; // Actions since the last tick, already encoded
+    size_t batchCount = 0;
+};
+
+struct ReplayRecord {
+    enum Kind : uint8_t { Open, State, Batch } kind;
+    int gridSize = 0;                // Open
+    EdgeRule rule = EdgeRule::Wrap;  // Open
+    std::string image;               // State
+    std::vector<Action> actions;     // Batch
+    bool ticked = false;             // Batch
+    uint64_t checksum = 0;           // Batch, when ticked
+};
+
+// Parses a whole log. A record cut short at the end, as left by a crash
+// mid-append, ends the log; anything else malformed fails with error set.
+bool parseReplayLog(const char* data, size_t size, std::vector<ReplayRecord>& records, std::string& error);
+
+// Parses records with no file preamble, as streamed to a follower. consumed
+// is how far the complete records reach.
+bool parseReplayRecords(const char* data, size_t size, std::vector<ReplayRecord>& records, size_t& consumed,
+                        std::string& error);
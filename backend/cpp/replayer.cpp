@@ -0,0 +1,128 @@
+#include "game.h"
+#include "bitboard.h"
+#include "replay.h"
+#include "log.h"
+#include "snapshot.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ReplayTotals {
+    long ticks = 0;
+    long actions = 0;
+    long states = 0;
+    long mismatches = 0;
+};
+
+// Re-simulates one parsed log. Only the first mismatch of each state is
+// reported; later ticks are still run and counted so the timing holds.
+bool replay(const string& name, const vector<ReplayRecord>& records, bool bitboard, bool report, ReplayTotals& totals) {
+    int gridSize = 0;
+    EdgeRule rule = EdgeRule::Wrap;
+    GameState state;
+    bool haveState = false, reported = false;
+    long tick = 0;
+    for (size_t r = 0; r < records.size(); ++r) {
+        const ReplayRecord& record = records[r];
+        switch (record.kind) {
+            case ReplayRecord::Open:
+                gridSize = record.gridSize;
+                rule = record.rule;
+                break;
+            case ReplayRecord::State:
+                state = GameState();
+                if (gridSize <= 0 || !decodeSnapshot(record.image.data(), record.image.size(), gridSize, state)) {
+                    cerr << name << ": unreadable state at record " << r << endl;
+                    return false;
+                }
+                haveState = true;
+                reported = false;
+                totals.states++;
+                break;
+            case ReplayRecord::Batch:
+                if (!haveState) {
+                    cerr << name << ": actions before any state at record " << r << endl;
+                    return false;
+                }
+                for (const Action& action : record.actions) applyAction(state, action, gridSize);
+                totals.actions += static_cast<long>(record.actions.size());
+                if (!record.ticked) break;
+                if (bitboard) simulateTickBitboard(state, gridSize, rule);
+                else simulateTick(state, gridSize, rule);
+                totals.ticks++;
+                tick++;
+                if (stateChecksum(state) != record.checksum) {
+                    totals.mismatches++;
+                    if (report && !reported) {
+                        cerr << name << ": checksum mismatch at tick " << tick << " (record " << r << ")" << endl;
+                        reported = true;
+                    }
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    bool bitboard = false;
+    bool usage = false;
+    int repeat = 1;
+    vector<string> paths;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--kernel=bitboard") bitboard = true;
+        else if (arg == "--kernel=reference") bitboard = false;
+        else if (arg.compare(0, 9, "--repeat=") == 0) repeat = max(1, atoi(arg.c_str() + 9));
+        else if (arg.compare(0, 2, "--") == 0) usage = true;
+        else paths.push_back(arg);
+    }
+    if (usage || paths.empty()) {
+        cerr << "Usage: glowrace_replay [--kernel=reference|bitboard] [--repeat=N] LOG..." << endl;
+        return 2;
+    }
+
+    // Everything is read and parsed up front so the timed loop does no I/O
+    vector<vector<ReplayRecord>> logs;
+    for (const string& path : paths) {
+        ifstream file(path, ios::binary);
+        if (!file) {
+            cerr << path << ": cannot open" << endl;
+            return 2;
+        }
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        vector<ReplayRecord> records;
+        string error;
+        if (!parseReplayLog(data.data(), data.size(), records, error)) {
+            cerr << path << ": " << error << endl;
+            return 2;
+        }
+        logs.push_back(move(records));
+    }
+
+    // Keep the core's logging, and its formatting, out of the timings
+    glowlog::setMinLevel(glowlog::Level::Off);
+    ReplayTotals totals;
+    bool ok = true;
+    auto begin = chrono::steady_clock::now();
+    for (int pass = 0; pass < repeat && ok; ++pass) {
+        for (size_t l = 0; l < logs.size() && ok; ++l) {
+            ok = replay(paths[l], logs[l], bitboard, pass == 0, totals);
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    if (!ok) return 2;
+
+    cout << "logs=" << logs.size() << " passes=" << repeat << " kernel=" << (bitboard ? "bitboard" : "reference") << endl;
+    cout << "ticks=" << totals.ticks << " actions=" << totals.actions << " states=" << totals.states << endl;
+    cout << "verify: " << (totals.mismatches == 0 ? "identical" : "MISMATCH") << " (" << totals.mismatches << " ticks differ)" << endl;
+    cout << "rate: " << (seconds > 0 ? totals.ticks / seconds : 0) << " ticks/s" << endl;
+    return totals.mismatches == 0 ? 0 : 1;
+}
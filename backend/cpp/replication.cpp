@@ -0,0 +1,254 @@
+#include "replication.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include "log.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Parses a varint at data[at]; false if the buffer ends first
+bool getVarint(const string& data, size_t& at, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && at < data.size(); shift += 7) {
+        unsigned char b = static_cast<unsigned char>(data[at++]);
+        value |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+sockaddr_un socketAddress(const string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+} // namespace
+
+void appendFrame(string& out, const string& roomId, string_view payload) {
+    putVarint(out, roomId.size());
+    out.append(roomId);
+    putVarint(out, payload.size());
+    out.append(payload);
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+int listenUnixSocket(const string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un address = socketAddress(path);
+    unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectUnixSocket(const string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un address = socketAddress(path);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool FrameReader::next(string& roomId, string& payload) {
+    char buffer[64 * 1024];
+    while (true) {
+        size_t cursor = at;
+        uint64_t idLength, payloadLength;
+        if (getVarint(pending, cursor, idLength) && pending.size() - cursor >= idLength) {
+            size_t idAt = cursor;
+            cursor += idLength;
+            if (getVarint(pending, cursor, payloadLength) && pending.size() - cursor >= payloadLength) {
+                roomId.assign(pending, idAt, idLength);
+                payload.assign(pending, cursor, payloadLength);
+                at = cursor + payloadLength;
+                return true;
+            }
+        }
+        // Only a partial frame is left; drop what was read before refilling
+        pending.erase(0, at);
+        at = 0;
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pending.append(buffer, static_cast<size_t>(n));
+    }
+}
+
+ReplicationLeader::Connection::~Connection() {
+    close(fd);
+}
+
+ReplicationLeader::~ReplicationLeader() {
+    // The threads run for the life of the process
+    if (acceptThread.joinable()) acceptThread.detach();
+    if (senderThread.joinable()) senderThread.detach();
+}
+
+bool ReplicationLeader::listen(const string& path) {
+    listener = listenUnixSocket(path);
+    if (listener < 0) return false;
+    acceptThread = thread(&ReplicationLeader::acceptLoop, this);
+    senderThread = thread(&ReplicationLeader::sendLoop, this);
+    return true;
+}
+
+void ReplicationLeader::send(const string& roomId, string payload) {
+    if (!hasFollower.load()) return;
+    string frame;
+    frame.reserve(roomId.size() + payload.size() + 10);
+    appendFrame(frame, roomId, payload);
+    bool queued;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (!follower) return;
+        queued = queuedBytes + frame.size() <= kMaxQueuedBytes;
+        if (queued) {
+            queuedBytes += frame.size();
+            queue.push_back(move(frame));
+        } else {
+            GLOWRACE_LOG(Warn) << "Replication follower is " << (queuedBytes >> 20) << " MB behind; dropping it";
+            detachLocked(follower);
+        }
+    }
+    if (queued) queueReady.notify_one();
+    else queueDrained.notify_all();
+}
+
+void ReplicationLeader::acceptLoop() {
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            GLOWRACE_LOG(Error) << "Replication accept failed: " << strerror(errno);
+            return;
+        }
+        auto connection = make_shared<Connection>(fd);
+        auto attach = [this, &connection] {
+            {
+                // One follower at a time; a newcomer replaces the old one
+                lock_guard<mutex> lock(queueMutex);
+                if (follower) detachLocked(follower);
+                follower = connection;
+                hasFollower.store(true);
+            }
+            GLOWRACE_LOG(Info) << "Replication follower attached";
+        };
+        if (onAttach) onAttach(attach);
+        else attach();
+        thread(&ReplicationLeader::readLoop, this, move(connection)).detach();
+    }
+}
+
+void ReplicationLeader::sendLoop() {
+    while (true) {
+        string frame;
+        shared_ptr<Connection> connection;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this] { return !queue.empty(); });
+            frame = move(queue.front());
+            queue.pop_front();
+            queuedBytes -= frame.size();
+            connection = follower;
+            writing = true;
+        }
+        if (connection && !writeAll(connection->fd, frame.data(), frame.size())) detach(connection);
+        {
+            lock_guard<mutex> lock(queueMutex);
+            writing = false;
+        }
+        queueDrained.notify_all();
+    }
+}
+
+void ReplicationLeader::flush(chrono::milliseconds timeout) {
+    unique_lock<mutex> lock(queueMutex);
+    queueDrained.wait_for(lock, timeout, [this] { return queue.empty() && !writing; });
+}
+
+void ReplicationLeader::readLoop(shared_ptr<Connection> connection) {
+    FrameReader reader(connection->fd);
+    string roomId, payload;
+    while (reader.next(roomId, payload)) {
+        if (onResync) onResync(roomId);
+    }
+    detach(connection);
+}
+
+void ReplicationLeader::detach(const shared_ptr<Connection>& connection) {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        detachLocked(connection);
+    }
+    queueDrained.notify_all();
+}
+
+void ReplicationLeader::detachLocked(shared_ptr<Connection> connection) {
+    if (follower != connection) return;
+    follower.reset();
+    hasFollower.store(false);
+    queue.clear();
+    queuedBytes = 0;
+    // Wakes the reader; the socket closes once the reader and sender let go
+    shutdown(connection->fd, SHUT_RDWR);
+    GLOWRACE_LOG(Info) << "Replication follower detached";
+}
+
+ReplicationFollower::~ReplicationFollower() {
+    if (fd >= 0) close(fd);
+}
+
+void ReplicationFollower::connect(const string& path) {
+    while (!tryConnect(path)) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+}
+
+bool ReplicationFollower::tryConnect(const string& path) {
+    if (fd >= 0) close(fd);
+    fd = connectUnixSocket(path);
+    return fd >= 0;
+}
+
+void ReplicationFollower::follow(const function<void(const string&, string_view)>& onFrame) {
+    FrameReader reader(fd);
+    string roomId, payload;
+    while (reader.next(roomId, payload)) onFrame(roomId, payload);
+}
+
+void ReplicationFollower::requestResync(const string& roomId) {
+    string frame;
+    appendFrame(frame, roomId, {});
+    writeAll(fd, frame.data(), frame.size());
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Streams replay records (replay.h) for every room from a leader to one
+// hot-standby follower over a Unix socket. Each frame is
+//
+//   varint idLength, room id, varint payloadLength, replay records
+//
+// and the follower writes back a frame with a room id and an empty payload
+// whenever a room's checksums stop matching, asking for a fresh state. A
+// follower that falls kMaxQueuedBytes behind is dropped; it finds the leader
+// still listening, reconnects and is sent every room again. A frame with an empty
+// room id and "restarting" as its payload means the leader is handing over
+// to a new process on the same socket, so the follower reconnects instead of
+// taking over.
+
+// Frame plumbing, shared with the hot-restart handoff in server.cpp
+void appendFrame(std::string& out, const std::string& roomId, std::string_view payload);
+bool writeAll(int fd, const char* data, size_t size);
+// A listening socket bound at path, replacing any stale one; -1 on failure
+int listenUnixSocket(const std::string& path);
+// One attempt; -1 if nothing accepts at path
+int connectUnixSocket(const std::string& path);
+
+// Reads frames off a socket one at a time
+class FrameReader {
+public:
+    explicit FrameReader(int fd) : fd(fd) {}
+    // Blocks for the next frame; false once the socket reports EOF or an error
+    bool next(std::string& roomId, std::string& payload);
+
+private:
+    int fd;
+    std::string pending;
+    size_t at = 0; // Start of the first unread frame in pending
+};
+
+// Leader side. send() only queues, so it is safe under the game lock; a
+// sender thread does the socket writes.
+class ReplicationLeader {
+public:
+    // Frames queued for the follower past this drop it
+    static constexpr size_t kMaxQueuedBytes = 64 << 20;
+
+    // Called on the accept thread once a follower connects. It must call
+    // attach(), which starts sending to the new follower, and queue the
+    // current state of every room in one critical section that no other
+    // send() gets into, so each room's state goes out ahead of its ticks
+    std::function<void(const std::function<void()>& attach)> onAttach;
+    // Called on the reader thread with each room the follower asks to resync
+    std::function<void(const std::string&)> onResync;
+
+    ~ReplicationLeader();
+
+    bool listen(const std::string& path);
+    bool attached() const { return hasFollower.load(); }
+    // Dropped unless a follower is attached
+    void send(const std::string& roomId, std::string payload);
+    // Waits up to timeout for queued frames to reach the follower
+    void flush(std::chrono::milliseconds timeout);
+
+private:
+    // A follower's socket, closed once neither the reader nor the sender
+    // holds it, so its descriptor is never reused under a pending write
+    struct Connection {
+        explicit Connection(int fd) : fd(fd) {}
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+        ~Connection();
+        const int fd;
+    };
+
+    void acceptLoop();
+    void sendLoop();
+    void readLoop(std::shared_ptr<Connection> connection);
+    void detach(const std::shared_ptr<Connection>& connection);
+    // Caller holds queueMutex
+    void detachLocked(std::shared_ptr<Connection> connection); // A copy: it may be follower itself
+
+    int listener = -1;
+    std::atomic<bool> hasFollower{false}; // Lets send() skip encoding with no one to send to
+    std::mutex queueMutex;
+    std::condition_variable queueReady, queueDrained;
+    std::shared_ptr<Connection> follower; // Guarded by queueMutex
+    std::deque<std::string> queue; // Encoded frames, all for follower
+    size_t queuedBytes = 0;
+    bool writing = false; // A frame is off the queue but not yet written
+    std::thread acceptThread, senderThread;
+};
+
+// Follower side
+class ReplicationFollower {
+public:
+    ~ReplicationFollower();
+
+    // Retries until the leader's socket accepts; closes any earlier connection
+    void connect(const std::string& path);
+    // One attempt; false, with no connection, if nothing accepts at path
+    bool tryConnect(const std::string& path);
+    // Hands every frame to onFrame until the leader goes away; returns as
+    // soon as the socket reports EOF or an error
+    void follow(const std::function<void(const std::string& roomId, std::string_view payload)>& onFrame);
+    void requestResync(const std::string& roomId);
+
+private:
+    int fd = -1;
+};
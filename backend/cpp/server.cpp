@@ -1,206 +1,491 @@
 #include "httplib.h"
 #include "json.hpp"
-#include <iostream>
+#include "game.h"
+#include "bitboard.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "replay.h"
+#include "replication.h"
+#include "flight_recorder.h"
+#include "protocol.h"
+#include "lock_profile.h"
+#include "log.h"
+#include "metrics.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <random>
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <unordered_map>
+#include <unordered_set>
 #include <atomic>
+#include <memory>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace httplib;
 using namespace nlohmann;
 using namespace std;
 
-struct Position {
-    int row, col;
+// Input latency for one room, segment by segment (see the Input histograms
+// in metrics.h). Written by the room's loop, read by /latency.
+struct InputLatency {
+    metrics::Distribution forward, apply, tickWait, tick, publish, total;
 };
 
-struct Player {
-    string id;
-    string name;
-    Position head;
-    vector<Position> tail;
-    string direction;
-    int score;
-    bool alive;
+// An action /update applied, waiting for the tick that moves with it
+struct PendingInput {
+    chrono::steady_clock::time_point ingress; // /update arrived
+    chrono::steady_clock::time_point applied;
+    int64_t forwardNs; // FastAPI to ingress if FastAPI stamped received_at_ms, else -1
+};
+const size_t kMaxPendingInputs = 16; // Further inputs between two ticks go untimed
+
+// The inputs one tick consumed, carried to the frame that publishes them
+struct TickInputs {
+    array<PendingInput, kMaxPendingInputs> inputs;
+    size_t count = 0;
+    chrono::steady_clock::time_point tickStart;
 };
 
-struct GameState {
-    vector<Player> players;
-    vector<Position> glowPoints;
-    bool gameOver;
-    int initialPlayerCount;
+// What a room's loop costs. Written by the loop, read by /rooms.
+struct TickStats {
+    metrics::Distribution cpu; // Thread CPU time per tick, simulating through publishing
+    atomic<int64_t> lastLatenessNs{0}; // How far past the 200 ms cadence the latest tick started
+    atomic<int64_t> publishingSinceNs{0}; // Steady clock when the tick's /state POST began; 0 when none is in flight
+    atomic<int64_t> lastPublishNs{0};
+    atomic<uint32_t> throttlePercent{100}; // Tick interval as a share of kTickInterval; above 100 while over the CPU budget
+};
+
+// A room's state and the arena it lives in; the arena outlives the state
+struct Room {
+    RoomArena arena;
+    GameState state{arena.room()};
+    size_t lastSnapshotBytes = 0; // Sizes the next snapshot's buffer up front
+    chrono::steady_clock::time_point lastActive = chrono::steady_clock::now(); // Last /update or published tick
+
+    unique_ptr<ReplayWriter> replay; // Set while GLOWRACE_REPLAY_DIR logging is on
+    int replayFd = -1;
+    unique_ptr<ReplayWriter> replication; // Set while leading a follower (GLOWRACE_REPLICATE)
+
+    array<PendingInput, kMaxPendingInputs> pendingInputs;
+    size_t pendingInputCount = 0;
+    size_t inputsSinceTick = 0; // Every action applied since the last tick, timed or not
+    uint64_t ticks = 0; // Simulated so far; each published frame carries it
+    uint64_t lastInputTick = 0; // The tick that consumed the latest timed input
+    unique_ptr<InputLatency> inputLatency; // Made on the first timed input
+    TickStats tickStats;
+    flight::Recorder flight; // The loop's last ticks, dumped on anomalies
+
+    Room() = default;
+    Room(const Room&) = delete;
+    Room& operator=(const Room&) = delete;
+    ~Room() {
+        if (replayFd >= 0) close(replayFd);
+    }
+
+    size_t bytesResident() const { return sizeof(Room) + arena.bytesHeld(); }
 };
 
-// Use a mutex and map to handle multiple game states per room_id
+// Use a mutex and map to handle multiple rooms per room_id. A room is only
+// erased by hibernation, which skips rooms whose game loop is still running,
+// so a loop's Room pointer stays valid after the mutex is released.
 timed_mutex gameStateMutex;
-unordered_map<string, GameState> gameStates;
-unordered_map<string, thread> gameThreads; // Track game loops per room
+unordered_map<string, unique_ptr<Room>> rooms;
+unordered_map<string, thread> gameThreads; // Track game loops per room; a loop removes itself when it parks
 atomic<bool> isRoomInitialized(false); // Flag to ensure room is set up
+bool useBitboardKernel = false; // GLOWRACE_TICK_KERNEL=bitboard
+int boardSize = 50; // GLOWRACE_GRID_SIZE
+EdgeRule edgeRule = EdgeRule::Wrap; // GLOWRACE_EDGE_RULE=walls
+// FastAPI, GLOWRACE_BACKEND=host:port; e.g. glowrace_loadgen's mock
+string backendHost = "backend";
+int backendPort = 8000;
 
-// Random number generator
-random_device rd;
-mt19937 gen(static_cast<unsigned int>(time(nullptr)));
-
-// Check if a position is occupied by any snake
-bool isPositionOccupied(const GameState& state, const Position& pos) {
-    cout << "Checking if position (" << pos.row << "," << pos.col << ") is occupied" << endl;
-    for (const auto& player : state.players) {
-        cout << "Checking player " << player.id << " head (" << player.head.row << "," << player.head.col << ")" << endl;
-        if (player.head.row == pos.row && player.head.col == pos.col) {
-            cout << "Position occupied by player head" << endl;
-            return true;
-        }
-        for (const auto& segment : player.tail) {
-            cout << "Checking tail segment (" << segment.row << "," << segment.col << ")" << endl;
-            if (segment.row == pos.row && segment.col == pos.col) {
-                cout << "Position occupied by player tail" << endl;
-                return true;
-            }
-        }
+// Room pool: spare rooms with warmed arenas, and loop threads waiting to be
+// handed a room, are made ahead of time without the game lock. Creating a
+// room or starting its loop then takes one from here.
+const size_t kWarmPlayers = 4; // Costs about what two joins would; 10 would double an idle room
+size_t roomPoolSize = 8; // GLOWRACE_ROOM_POOL spares of each; 0 disables the pool
+struct SpareLoop {
+    thread worker;
+    promise<pair<string, Room*>> assignment;
+};
+mutex poolMutex;
+condition_variable poolLow;
+vector<unique_ptr<Room>> spareRooms;
+vector<SpareLoop> spareLoops;
+
+// Hibernation: once resident rooms pass the memory budget, rooms with a
+// parked loop are written to disk, least recently active first, and dropped
+// until their next /update or /reset. All of it is guarded by gameStateMutex.
+size_t memoryBudget = 0; // GLOWRACE_MEMORY_BUDGET_MB; 0 disables hibernation
+string hibernateDir = "/tmp/glowrace-rooms"; // GLOWRACE_HIBERNATE_DIR
+unordered_set<string> hibernatedRooms;
+struct ReloadStats {
+    uint64_t count = 0;
+    double lastMs = 0;
+    double totalMs = 0;
+    double maxMs = 0;
+} reloadStats;
+const auto kParkAfter = chrono::seconds(5); // A loop with no one alive this long exits
+const auto kTickInterval = chrono::milliseconds(200);
+// A tick taking longer than this, lock waits and publishing included, dumps
+// its room's flight record (GLOWRACE_TICK_BUDGET_MS; GLOWRACE_FLIGHT_DIR)
+chrono::milliseconds tickBudget(50);
+// Noisy neighbours: a room whose smoothed tick CPU passes roomCpuBudget
+// (GLOWRACE_ROOM_CPU_BUDGET_MS; 0 disables) ticks less often, so it gets at
+// most its budget per kTickInterval however costly its ticks, and the rooms
+// sharing the cores and the game lock keep their cadence. A room throttled
+// for roomEvictAfter (GLOWRACE_ROOM_EVICT_SECS; 0, the default, never) has
+// its game wiped.
+chrono::microseconds roomCpuBudget(20000);
+chrono::seconds roomEvictAfter(0);
+const double kMaxThrottle = 10; // A throttled room still ticks every 2 s
+
+// Resets: the tick or endGame that ends a room's game queues one job for that
+// room, and the reset thread loads the room's next state from FastAPI. Rooms
+// are never scanned for it. resetMutex guards only the queue.
+mutex resetMutex;
+condition_variable resetReady;
+deque<string> resetJobs;
+unordered_set<string> queuedResets; // Rooms in resetJobs, each queued once
+
+// Replay logs: with GLOWRACE_REPLAY_DIR set, every room appends its states,
+// actions and tick checksums to <dir>/<room>.log for glowrace_replay.
+// Records are buffered in the room and written out by the monitor.
+string replayDir;
+
+// Hot standby: a leader (GLOWRACE_REPLICATE=<socket>) streams the same
+// records to a follower (GLOWRACE_FOLLOW=<socket>) every tick. The follower
+// re-simulates them, asks for a fresh state when a checksum disagrees, and
+// takes over serving as soon as the leader's socket closes.
+ReplicationLeader replicationLeader;
+bool replicating = false;
+
+// Checkpointing: every room, resident or hibernated, is written to one file
+// this often, and a restarted server resumes from it before taking requests
+string checkpointPath; // GLOWRACE_CHECKPOINT; empty disables checkpoints
+chrono::seconds checkpointEvery(5); // GLOWRACE_CHECKPOINT_SECS
+
+// Hot restart: a server started with GLOWRACE_HANDOFF=<socket> while another
+// one waits there takes that server's rooms over the socket and binds port
+// 9000 beside it (httplib sets SO_REUSEPORT). The old server then stops
+// accepting, forwards the requests still in flight to the new one, and exits.
+string handoffPath; // GLOWRACE_HANDOFF
+atomic<bool> draining(false); // Rooms are frozen for a handoff or shutdown; set under gameStateMutex
+atomic<bool> shutdownRequested(false); // SIGTERM, SIGINT or a completed handoff
+mutex successorMutex; // One forwarded request at a time on the successor's socket
+int successorFd = -1;
+unique_ptr<FrameReader> successorReader;
+
+// Seed for a new room's Rng. GLOWRACE_SEED pins it so a run can be replayed;
+// the room id is mixed in so rooms in the same run still differ.
+uint64_t newRoomSeed(const string& roomId) {
+    static random_device rd;
+    static mutex seedMutex;
+    if (const char* fixed = getenv("GLOWRACE_SEED")) {
+        uint64_t hash = 1469598103934665603ULL; // FNV-1a
+        for (unsigned char c : roomId) hash = (hash ^ c) * 1099511628211ULL;
+        return strtoull(fixed, nullptr, 10) ^ hash;
     }
-    cout << "Position not occupied" << endl;
-    return false;
+    lock_guard<mutex> lock(seedMutex);
+    return (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
 }
 
-// Generate a random position that is not occupied
-Position getRandomPosition(int gridSize, const GameState& state) {
-    cout << "Generating random position for grid size " << gridSize << endl;
-    uniform_int_distribution<> dis(0, gridSize - 1);
-    Position pos;
-    int maxAttempts = gridSize * gridSize;
-    int attempts = 0;
-    do {
-        try {
-            pos = {dis(gen), dis(gen)};
-            cout << "Attempt " << attempts + 1 << ": Generated position (" << pos.row << "," << pos.col << ")" << endl;
-        } catch (const std::exception& e) {
-            cout << "Error generating random position: " << e.what() << endl;
-            pos = {0, 0};
-            break;
-        }
-        attempts++;
-        if (attempts >= maxAttempts) {
-            cout << "Warning: Could not find an unoccupied position after " << maxAttempts << " attempts, using (" << pos.row << "," << pos.col << ")" << endl;
-            break;
-        }
-    } while (isPositionOccupied(state, pos));
-    cout << "Final position: (" << pos.row << "," << pos.col << ")" << endl;
-    return pos;
-}
-
-// Generate a random direction
-string getRandomDirection() {
-    cout << "Generating random direction" << endl;
-    uniform_int_distribution<> dis(0, 3);
-    string direction;
-    try {
-        switch (dis(gen)) {
-            case 0: direction = "up"; break;
-            case 1: direction = "down"; break;
-            case 2: direction = "left"; break;
-            case 3: direction = "right"; break;
-            default: direction = "right";
-        }
-    } catch (const std::exception& e) {
-        cout << "Error generating random direction: " << e.what() << endl;
-        direction = "right";
-    }
-    cout << "Generated direction: " << direction << endl;
-    return direction;
-}
-
-string gameStateToJson(const GameState& state) {
-    json j;
-    j["players"] = json::array();
-    for (const auto& player : state.players) {
-        json p;
-        p["id"] = player.id;
-        p["name"] = player.name;
-        p["row"] = player.head.row;
-        p["col"] = player.head.col;
-        p["tail"] = json::array();
-        for (const auto& segment : player.tail) {
-            p["tail"].push_back({{"row", segment.row}, {"col", segment.col}});
-        }
-        p["direction"] = player.direction;
-        p["score"] = player.score;
-        p["alive"] = player.alive;
-        j["players"].push_back(p);
-    }
-    j["glowPoints"] = json::array();
-    for (const auto& glow : state.glowPoints) {
-        j["glowPoints"].push_back({{"row", glow.row}, {"col", glow.col}});
-    }
-    j["gameOver"] = state.gameOver;
-    j["room_id"] = ""; // Will be set by the caller
-    return j.dump();
-}
-
-GameState loadGameState(const string& roomId) {
-    Client cli("backend", 8000);
+// An empty state with room for kWarmPlayers, as in a pooled room, so the
+// first joins allocate nothing
+GameState warmState(uint64_t seed, pmr::memory_resource* resource) {
+    GameState state(resource);
+    state.setSeed(seed);
+    state.reserve(kWarmPlayers);
+    return state;
+}
+
+// Loaded state is built directly in the given resource, normally the room's
+// arena, so assigning it to the room moves buffers instead of copying them,
+// warm reserve included
+GameState loadGameState(const string& roomId, uint64_t seed, pmr::memory_resource* resource) {
+    Client cli(backendHost, backendPort);
     cli.set_connection_timeout(2);
     cli.set_read_timeout(2);
     cli.set_write_timeout(2);
+    auto start = chrono::steady_clock::now();
     auto res = cli.Get("/load_state?room_id=" + roomId);
+    metrics::observe(metrics::Histogram::LoadStateSeconds, chrono::steady_clock::now() - start);
+    if (!res || res->status != 200) metrics::add(metrics::Counter::LoadStateErrors);
     if (res && res->status == 200) {
         try {
-            auto state = json::parse(res->body);
-            GameState loadedState;
-
-            for (const auto& p : state.value("players", json::array())) {
-                Player player;
-                player.id = p.value("id", "UnknownPlayer");
-                player.name = p.value("name", "Unknown");
-                player.head.row = p.value("row", 0);
-                player.head.col = p.value("col", 0);
-                player.tail.clear();
-                for (const auto& segment : p.value("tail", json::array())) {
-                    player.tail.push_back({segment.value("row", 0), segment.value("col", 0)});
-                }
-                player.direction = p.value("direction", "right");
-                player.score = p.value("score", 0);
-                player.alive = p.value("alive", true);
-                loadedState.players.push_back(player);
-            }
-
-            loadedState.glowPoints.clear();
-            for (const auto& glow : state.value("glowPoints", json::array())) {
-                loadedState.glowPoints.push_back({glow.value("row", 0), glow.value("col", 0)});
-            }
-
-            loadedState.initialPlayerCount = loadedState.players.size();
-            int aliveCount = 0;
-            for (const auto& player : loadedState.players) {
-                if (player.alive) aliveCount++;
-            }
-            loadedState.gameOver = (aliveCount == 0);
-            cout << "Loaded game state for room " << roomId << ": aliveCount=" << aliveCount << ", initialPlayerCount=" << loadedState.initialPlayerCount << ", gameOver=" << loadedState.gameOver << endl;
+            GameState loadedState = warmState(seed, resource);
+            parseLoadedState(res->body, boardSize, loadedState);
+            GLOWRACE_LOG(Debug) << "Loaded game state for room " << roomId << ": initialPlayerCount=" << loadedState.initialPlayerCount << ", gameOver=" << loadedState.gameOver << ", seed=" << seed;
             return loadedState;
         } catch (const json::exception& e) {
-            cout << "JSON parsing error for room " << roomId << ": " << e.what() << endl;
-            GameState emptyState;
-            emptyState.players.clear();
-            emptyState.glowPoints.clear();
-            emptyState.gameOver = false;
-            emptyState.initialPlayerCount = 0;
-            return emptyState;
+            GLOWRACE_LOG(Error) << "JSON parsing error for room " << roomId << ": " << e.what();
+            return warmState(seed, resource);
+        }
+    }
+    GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to load game state from FastAPI for room " << roomId << ", status: " << (res ? res->status : -1);
+    return warmState(seed, resource);
+}
+
+// Room ids are arbitrary text, so per-room files are named by the id in hex
+string roomFileName(const string& roomId) {
+    static const char* hex = "0123456789abcdef";
+    string name;
+    for (unsigned char c : roomId) {
+        name.push_back(hex[c >> 4]);
+        name.push_back(hex[c & 15]);
+    }
+    return name;
+}
+
+string hibernationPath(const string& roomId) {
+    return hibernateDir + "/" + roomFileName(roomId) + ".room";
+}
+
+// Opens the room's replay log for appending, starting the file if it is new.
+// Caller holds gameStateMutex.
+void openReplayLog(const string& roomId, Room& room) {
+    if (replayDir.empty()) return;
+    string path = replayDir + "/" + roomFileName(roomId) + ".log";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        GLOWRACE_LOG(Error) << "Failed to open replay log " << path << " for room " << roomId;
+        return;
+    }
+    struct stat info;
+    room.replay = make_unique<ReplayWriter>();
+    room.replayFd = fd;
+    if (fstat(fd, &info) == 0 && info.st_size == 0) room.replay->start();
+    room.replay->open(boardSize, edgeRule);
+}
+
+void openReplication(Room& room) {
+    if (!replicating) return;
+    room.replication = make_unique<ReplayWriter>();
+    room.replication->open(boardSize, edgeRule);
+}
+
+// Sends what the room recorded since the last call on to the follower
+void replicate(const string& roomId, Room& room) {
+    if (room.replication && !room.replication->empty()) replicationLeader.send(roomId, room.replication->take());
+}
+
+// Logs that the room's state was replaced wholesale. Caller holds gameStateMutex.
+void recordRoomState(const string& roomId, Room& room) {
+    if (room.replay) room.replay->recordState(room.state, boardSize);
+    if (room.replication) {
+        room.replication->recordState(room.state, boardSize);
+        replicate(roomId, room);
+    }
+}
+
+// An action from /update or the leader, applied and journaled. Actions reach
+// the follower with the next tick. Caller holds gameStateMutex.
+ActionResult applyRoomAction(Room& room, const Action& action) {
+    ActionResult result = applyAction(room.state, action, boardSize);
+    if (room.replay) room.replay->recordAction(action);
+    if (room.replication) room.replication->recordAction(action);
+    return result;
+}
+
+// One tick and its journal entries. kernel is the specialized tick for this
+// board, or nullptr for simulateTick. Caller holds gameStateMutex.
+// Returns the state's checksum after the tick
+uint64_t advanceRoom(const string& roomId, Room& room, TickKernel kernel) {
+    if (kernel) {
+        kernel(room.state);
+    } else {
+        simulateTick(room.state, boardSize, edgeRule);
+    }
+    uint64_t checksum = stateChecksum(room.state);
+    if (room.replay) room.replay->recordTick(checksum);
+    if (room.replication) {
+        room.replication->recordTick(checksum);
+        replicate(roomId, room);
+    }
+    return checksum;
+}
+
+bool hasAlivePlayers(const GameState& state) {
+    return find(state.alive.begin(), state.alive.end(), 1) != state.alive.end();
+}
+
+// Players joined and none is left alive: the game ended and the room has not
+// been reset since. For rooms whose ending was not seen here, e.g. resumed ones.
+bool awaitingReset(const GameState& state) {
+    return state.playerCount() > 0 && !hasAlivePlayers(state);
+}
+
+void queueReset(const string& roomId) {
+    {
+        lock_guard<mutex> lock(resetMutex);
+        if (!queuedResets.insert(roomId).second) return;
+        resetJobs.push_back(roomId);
+    }
+    resetReady.notify_one();
+}
+
+// Held from taking a batch of replay records until it is written, so a log
+// never gets a later batch ahead of an earlier one. Taken after gameStateMutex.
+mutex replayWriteMutex;
+
+void writeReplay(int fd, const string& bytes) {
+    const char* data = bytes.data();
+    size_t left = bytes.size();
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written <= 0) return;
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+}
+
+unique_ptr<Room> makeWarmRoom() {
+    auto room = make_unique<Room>();
+    room->state.reserve(kWarmPlayers);
+    return room;
+}
+
+// A spare room from the pool, or a cold one if the pool has run dry
+unique_ptr<Room> takeSpareRoom() {
+    unique_ptr<Room> room;
+    {
+        lock_guard<mutex> lock(poolMutex);
+        if (!spareRooms.empty()) {
+            room = move(spareRooms.back());
+            spareRooms.pop_back();
         }
     }
-    cout << "Failed to load game state from FastAPI for room " << roomId << ", status: " << (res ? res->status : -1) << endl;
-    GameState emptyState;
-    emptyState.players.clear();
-    emptyState.glowPoints.clear();
-    emptyState.gameOver = false;
-    emptyState.initialPlayerCount = 0;
-    return emptyState;
+    poolLow.notify_one();
+    return room ? move(room) : make_unique<Room>();
+}
+
+// A new, empty room with its journals open. Caller holds gameStateMutex.
+Room* createRoom(const string& roomId) {
+    unique_ptr<Room>& created = rooms[roomId];
+    created = takeSpareRoom();
+    openReplayLog(roomId, *created);
+    openReplication(*created);
+    return created.get();
+}
+
+// Replaces the room's state with an image encoded by another process,
+// creating the room if needed. Caller holds gameStateMutex.
+bool restoreRoom(const string& roomId, const string& image) {
+    auto it = rooms.find(roomId);
+    Room* room = it != rooms.end() ? it->second.get() : createRoom(roomId);
+    room->state = GameState(room->arena.room());
+    if (!decodeSnapshot(image.data(), image.size(), boardSize, room->state)) return false;
+    recordRoomState(roomId, *room);
+    return true;
+}
+
+// Writes the room's snapshot to disk. The caller drops the room on success.
+bool hibernateRoom(const string& roomId, Room& room) {
+    string image;
+    encodeSnapshot(room.state, boardSize, image);
+    string path = hibernationPath(roomId);
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(image.data(), static_cast<streamsize>(image.size()));
+    file.close();
+    if (!file) {
+        GLOWRACE_LOG(Error) << "Failed to write hibernation snapshot for room " << roomId << " to " << path;
+        filesystem::remove(path);
+        return false;
+    }
+    hibernatedRooms.insert(roomId);
+    if (room.replay && !room.replay->empty()) writeReplay(room.replayFd, room.replay->take());
+    GLOWRACE_LOG(Info) << "Hibernated room " << roomId << ": " << room.bytesResident() << " bytes resident, " << image.size() << " bytes on disk";
+    return true;
+}
+
+// The resident room for roomId, reloading it from its hibernation snapshot
+// if it was dropped. Returns nullptr for a room that is neither, or whose
+// snapshot could not be read; that snapshot is kept aside as <path>.bad and
+// the caller starts the room over. Caller holds gameStateMutex.
+Room* residentRoom(const string& roomId) {
+    auto it = rooms.find(roomId);
+    if (it != rooms.end()) return it->second.get();
+    if (hibernatedRooms.count(roomId) == 0) return nullptr;
+
+    auto start = chrono::steady_clock::now();
+    string path = hibernationPath(roomId);
+    ifstream file(path, ios::binary);
+    string image((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    bool read = file.is_open() && !file.bad();
+    file.close();
+    auto room = make_unique<Room>();
+    if (!read || !decodeSnapshot(image.data(), image.size(), boardSize, room->state)) {
+        hibernatedRooms.erase(roomId);
+        error_code error;
+        filesystem::rename(path, path + ".bad", error);
+        GLOWRACE_LOG(Error) << "Unreadable hibernation snapshot for room " << roomId << " (" << image.size()
+                            << " bytes); kept as " << path << ".bad and starting the room over";
+        return nullptr;
+    }
+    hibernatedRooms.erase(roomId);
+    filesystem::remove(path);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    reloadStats.count++;
+    reloadStats.lastMs = ms;
+    reloadStats.totalMs += ms;
+    reloadStats.maxMs = max(reloadStats.maxMs, ms);
+    GLOWRACE_LOG(Info) << "Reloaded hibernated room " << roomId << " in " << ms << " ms";
+    Room* resident = room.get();
+    openReplayLog(roomId, *resident);
+    openReplication(*resident);
+    rooms[roomId] = move(room);
+    return resident;
+}
+
+// Hibernates parked rooms, least recently active first, until resident
+// rooms are back under 90% of the budget. Caller holds gameStateMutex.
+void enforceMemoryBudget() {
+    if (memoryBudget == 0) return;
+    size_t total = 0;
+    for (const auto& [roomId, room] : rooms) total += room->bytesResident();
+    if (total <= memoryBudget) return;
+
+    vector<pair<chrono::steady_clock::time_point, string>> parked;
+    for (const auto& [roomId, room] : rooms) {
+        if (gameThreads.find(roomId) == gameThreads.end()) parked.emplace_back(room->lastActive, roomId);
+    }
+    sort(parked.begin(), parked.end());
+    size_t target = memoryBudget / 10 * 9;
+    for (const auto& [lastActive, roomId] : parked) {
+        if (total <= target) break;
+        auto it = rooms.find(roomId);
+        size_t bytes = it->second->bytesResident();
+        if (!hibernateRoom(roomId, *it->second)) continue;
+        rooms.erase(it);
+        total -= bytes;
+    }
+    GLOWRACE_LOG(Info) << "Memory budget " << memoryBudget << " bytes: " << total << " resident in " << rooms.size()
+         << " rooms, " << hibernatedRooms.size() << " hibernated";
 }
 
 bool checkResetFlag(const string& roomId) {
-    Client cli("backend", 8000);
+    Client cli(backendHost, backendPort);
     cli.set_connection_timeout(2);
     cli.set_read_timeout(2);
     cli.set_write_timeout(2);
@@ -212,409 +497,1467 @@ bool checkResetFlag(const string& roomId) {
     return false;
 }
 
-void sendGameState(const string& roomId) {
-    cout << "Attempting to send game state for room " << roomId << " to FastAPI" << endl;
-    Client cli("backend", 8000);
+// True if FastAPI took the frame
+bool postGameState(const string& roomId, const char* stateJson, size_t length) {
+    Client cli(backendHost, backendPort);
     cli.set_connection_timeout(2);
     cli.set_read_timeout(2);
     cli.set_write_timeout(2);
+    auto start = chrono::steady_clock::now();
+    try {
+        auto res = cli.Post("/state", stateJson, length, "application/json");
+        metrics::observe(metrics::Histogram::StateSeconds, chrono::steady_clock::now() - start);
+        if (res && res->status == 200) {
+            GLOWRACE_LOG(Trace) << "Successfully sent game state to FastAPI for room " << roomId << ": " << string_view(stateJson, length);
+            return true;
+        } else {
+            metrics::add(metrics::Counter::StateErrors);
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to send game state to FastAPI for room " << roomId << ", status: " << (res ? res->status : -1);
+            if (res) {
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "FastAPI response: " << res->body;
+            } else {
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "No response received from FastAPI for room " << roomId;
+            }
+        }
+    } catch (const std::exception& e) {
+        metrics::observe(metrics::Histogram::StateSeconds, chrono::steady_clock::now() - start);
+        metrics::add(metrics::Counter::StateErrors);
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Exception while sending game state to FastAPI for room " << roomId << ": " << e.what();
+    }
+    return false;
+}
+
+void sendGameState(const string& roomId) {
+    GLOWRACE_LOG(Trace) << "Attempting to send game state for room " << roomId << " to FastAPI";
     string stateJson;
     {
-        cout << "Acquiring mutex in sendGameState for room " << roomId << endl;
-        if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-            lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-            cout << "Mutex acquired in sendGameState for room " << roomId << endl;
-            auto it = gameStates.find(roomId);
-            if (it != gameStates.end()) {
-                json j = json::parse(gameStateToJson(it->second));
-                j["room_id"] = roomId;
-                stateJson = j.dump();
+        GLOWRACE_LOG(Trace) << "Acquiring mutex in sendGameState for room " << roomId;
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::SendState, chrono::seconds(10));
+        if (lock) {
+            GLOWRACE_LOG(Trace) << "Mutex acquired in sendGameState for room " << roomId;
+            auto it = rooms.find(roomId);
+            if (it != rooms.end()) {
+                stateJson = gameStateToJson(it->second->state, roomId);
             } else {
-                cout << "No game state found for room " << roomId << endl;
+                GLOWRACE_LOG(Warn) << "No game state found for room " << roomId;
                 return;
             }
-            cout << "Mutex released in sendGameState for room " << roomId << endl;
+            GLOWRACE_LOG(Trace) << "Mutex released in sendGameState for room " << roomId;
         } else {
-            cout << "Failed to acquire mutex in sendGameState for room " << roomId << " after 10 seconds" << endl;
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in sendGameState for room " << roomId << " after 10 seconds";
+            flight::requestDump(roomId, "lock_timeout");
             return;
         }
     }
-    try {
-        auto res = cli.Post("/state", stateJson, "application/json");
-        if (res && res->status == 200) {
-            cout << "Successfully sent game state to FastAPI for room " << roomId << ": " << stateJson << endl;
-        } else {
-            cout << "Failed to send game state to FastAPI for room " << roomId << ", status: " << (res ? res->status : -1) << endl;
-            if (res) {
-                cout << "FastAPI response: " << res->body << endl;
-            } else {
-                cout << "No response received from FastAPI for room " << roomId << endl;
+    postGameState(roomId, stateJson.data(), stateJson.size());
+}
+
+// sendGameState for the room's own loop: the snapshot is serialized into the
+// room's tick scratch, which is reset wholesale at the start of every publish.
+// Once the room is warm this allocates nothing until the POST itself.
+void publishTick(const string& roomId, Room& room, const TickInputs& consumed) {
+    flight::Tick& record = room.flight.current();
+    ProfiledLock lock(gameStateMutex, metrics::LockSite::Publish, chrono::seconds(10));
+    record.publishWaitUs = flight::micros(lock.waited());
+    if (!lock) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in publishTick for room " << roomId << " after 10 seconds";
+        record.flags |= flight::LockTimeout;
+        return;
+    }
+    auto snapshotStart = chrono::steady_clock::now();
+    room.arena.resetTick();
+    pmr::string stateJson(room.arena.tick());
+    {
+        glowtrace::Span span("snapshot");
+        stateJson.reserve(room.lastSnapshotBytes + room.lastSnapshotBytes / 8);
+        appendGameStateJson(room.state, roomId, stateJson);
+        // Stamp the frame with its tick, last so the keys stay sorted
+        char digits[24];
+        auto end = to_chars(digits, digits + sizeof(digits), room.ticks).ptr;
+        stateJson.pop_back();
+        stateJson.append(",\"tick\":").append(digits, end).push_back('}');
+    }
+    room.lastSnapshotBytes = stateJson.size();
+    auto serialized = chrono::steady_clock::now();
+    record.snapshotUs = flight::micros(serialized - snapshotStart);
+    room.lastActive = serialized;
+    InputLatency* latency = room.inputLatency.get();
+    lock.unlock();
+    {
+        glowtrace::Span span("publish");
+        room.tickStats.publishingSinceNs.store(chrono::nanoseconds(serialized.time_since_epoch()).count(), memory_order_relaxed);
+        if (!postGameState(roomId, stateJson.data(), stateJson.size())) record.flags |= flight::PublishFailed;
+        room.tickStats.publishingSinceNs.store(0, memory_order_relaxed);
+    }
+    auto published = chrono::steady_clock::now();
+    record.publishUs = flight::micros(published - serialized);
+    room.tickStats.lastPublishNs.store(chrono::nanoseconds(published - serialized).count(), memory_order_relaxed);
+    if (consumed.count == 0 || !latency) return;
+    for (size_t i = 0; i < consumed.count; i++) {
+        const PendingInput& input = consumed.inputs[i];
+        if (input.forwardNs >= 0) {
+            auto forward = chrono::nanoseconds(input.forwardNs);
+            latency->forward.observe(forward);
+            metrics::observe(metrics::Histogram::InputForwardSeconds, forward);
+        }
+        latency->apply.observe(input.applied - input.ingress);
+        latency->tickWait.observe(consumed.tickStart - input.applied);
+        latency->tick.observe(serialized - consumed.tickStart);
+        latency->publish.observe(published - serialized);
+        latency->total.observe(published - input.ingress);
+        metrics::observe(metrics::Histogram::InputApplySeconds, input.applied - input.ingress);
+        metrics::observe(metrics::Histogram::InputTickWaitSeconds, consumed.tickStart - input.applied);
+        metrics::observe(metrics::Histogram::InputTickSeconds, serialized - consumed.tickStart);
+        metrics::observe(metrics::Histogram::InputPublishSeconds, published - serialized);
+        metrics::observe(metrics::Histogram::InputTotalSeconds, published - input.ingress);
+    }
+}
+
+// consumed gets the inputs applied since the last tick
+void gameTick(const string& roomId, Room& room, TickKernel kernel, TickInputs& consumed) {
+    consumed.count = 0;
+    GLOWRACE_LOG(Trace) << "Running gameTick for room " << roomId;
+    flight::Tick& record = room.flight.current();
+    ProfiledLock lock(gameStateMutex, metrics::LockSite::Tick, chrono::seconds(10));
+    record.tickWaitUs = flight::micros(lock.waited());
+    if (lock) {
+        GLOWRACE_LOG(Trace) << "Mutex acquired in gameTick for room " << roomId;
+        if (!draining) { // A frozen room may already be ticking elsewhere
+            bool wasOver = room.state.gameOver;
+            auto start = chrono::steady_clock::now();
+            copy_n(room.pendingInputs.begin(), room.pendingInputCount, consumed.inputs.begin());
+            consumed.count = room.pendingInputCount;
+            consumed.tickStart = start;
+            room.pendingInputCount = 0;
+            room.inputsSinceTick = 0;
+            room.flight.takeInputs(record);
+            room.ticks++;
+            if (consumed.count > 0) room.lastInputTick = room.ticks;
+            glowtrace::Span span("simulate");
+            record.tick = room.ticks;
+            record.checksum = advanceRoom(roomId, room, kernel);
+            auto simulated = chrono::steady_clock::now();
+            metrics::observe(metrics::Histogram::TickSeconds, simulated - start);
+            record.simulateUs = flight::micros(simulated - start);
+            const GameState& state = room.state;
+            record.players = static_cast<uint16_t>(min<size_t>(state.playerCount(), UINT16_MAX));
+            record.alive = static_cast<uint16_t>(count(state.alive.begin(), state.alive.end(), 1));
+            record.glow = static_cast<uint16_t>(min<size_t>(state.glowPoints.size(), UINT16_MAX));
+            if (!wasOver && room.state.gameOver) queueReset(roomId);
+        }
+        GLOWRACE_LOG(Trace) << "Mutex released in gameTick for room " << roomId;
+    } else {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in gameTick for room " << roomId << " after 10 seconds";
+        record.flags |= flight::LockTimeout;
+    }
+}
+
+// Runs queued resets for the life of the process. The next state is loaded
+// without the lock; if a player rejoined meanwhile the game is back on and
+// the loaded state is dropped.
+void resetWorker() {
+    glowtrace::nameThread("reset worker");
+    while (true) {
+        string roomId;
+        {
+            unique_lock<mutex> lock(resetMutex);
+            resetReady.wait(lock, [] { return !resetJobs.empty(); });
+            roomId = move(resetJobs.front());
+            resetJobs.pop_front();
+            queuedResets.erase(roomId);
+        }
+        GameState loaded = loadGameState(roomId, newRoomSeed(roomId), pmr::get_default_resource());
+        {
+            ProfiledLock lock(gameStateMutex, metrics::LockSite::ResetWorker, chrono::seconds(10));
+            if (!lock) {
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex to reset room " << roomId << " after 10 seconds";
+                flight::requestDump(roomId, "lock_timeout");
+                continue;
             }
+            // A frozen room is reset by whichever server takes it
+            Room* room = draining ? nullptr : residentRoom(roomId);
+            if (!room || !shouldResetGameState(room->state)) continue;
+            room->state = move(loaded); // Copied into the room's arena
+            room->state.reserve(kWarmPlayers); // The copy kept no spare capacity
+            room->pendingInputCount = 0;
+            recordRoomState(roomId, *room);
+            GLOWRACE_LOG(Info) << "Game state reset to loaded state for room " << roomId << ": " << gameStateToJson(room->state);
         }
-    } catch (const std::exception& e) {
-        cout << "Exception while sending game state to FastAPI for room " << roomId << ": " << e.what() << endl;
-    }
-}
-
-Position getNextPosition(const Player& player, int gridSize) {
-    Position next = player.head;
-    cout << "Calculating next position for player " << player.id << " with direction " << player.direction << endl;
-    if (player.direction == "up") next.row--;
-    else if (player.direction == "down") next.row++;
-    else if (player.direction == "left") next.col--;
-    else if (player.direction == "right") next.col++;
-    if (next.row < 0) next.row = gridSize - 1;
-    if (next.row >= gridSize) next.row = 0;
-    if (next.col < 0) next.col = gridSize - 1;
-    if (next.col >= gridSize) next.col = 0;
-    cout << "Next position: (" << next.row << "," << next.col << ")" << endl;
-    return next;
-}
-
-void checkCollisions(GameState& state, int gridSize) {
-    for (size_t i = 0; i < state.players.size(); ++i) {
-        if (!state.players[i].alive) continue;
-        Position currentPos = state.players[i].head;
-        cout << "Checking collisions for player " << state.players[i].id << " at position (" << currentPos.row << "," << currentPos.col << ")" << endl;
-
-        for (size_t j = 0; j < state.players.size(); ++j) {
-            if (i != j && state.players[j].alive) {
-                if (currentPos.row == state.players[j].head.row && currentPos.col == state.players[j].head.col) {
-                    cout << "Head-to-head collision between player " << state.players[i].id << " and player " << state.players[j].id << endl;
-                    if (state.players[i].score > state.players[j].score) {
-                        state.players[j].alive = false;
-                        for(auto ele: state.players[j].tail) {
-                            state.glowPoints.push_back(ele);
-                        }
-                        cout << "Player " << state.players[j].id << " killed by player " << state.players[i].id << " (score comparison)" << endl;
-                        state.players.erase(state.players.begin() + j);
-                    } else if (state.players[i].score < state.players[j].score) {
-                        state.players[i].alive = false;
-                        for(auto ele: state.players[i].tail) {
-                            state.glowPoints.push_back(ele);
-                        }
-                        cout << "Player " << state.players[i].id << " killed by player " << state.players[j].id << " (score comparison)" << endl;
-                        state.players.erase(state.players.begin() + i);
-                    } else {
-                        state.players[i].alive = false;
-                        state.players[j].alive = false;
-                        for(auto ele: state.players[i].tail) {
-                            state.glowPoints.push_back(ele);
-                        }
-                        for(auto ele: state.players[j].tail) {
-                            state.glowPoints.push_back(ele);
-                        }
-                        cout << "Both players " << state.players[i].id << " and " << state.players[j].id << " killed (equal scores)" << endl;
-                        state.players.erase(state.players.begin() + i);
-                        state.players.erase(state.players.begin() + j);
-                    }
+        sendGameState(roomId);
+    }
+}
+
+// CPU the calling thread has used; unlike wall time, not inflated by waits
+// for the lock or the network
+chrono::nanoseconds threadCpuTime() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return chrono::seconds(now.tv_sec) + chrono::nanoseconds(now.tv_nsec);
+}
+
+// Writes the room's flight record, naming its players if the lock comes
+// quickly; after a lock timeout it may not. Called on the room's loop.
+void dumpFlight(const string& roomId, Room& room, const char* reason) {
+    vector<pair<uint16_t, string>> players;
+    {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Flight, chrono::milliseconds(100));
+        if (lock) {
+            const GameState& state = room.state;
+            for (size_t i = 0; i < state.slotCount(); ++i) {
+                if (state.occupied[i]) players.emplace_back(static_cast<uint16_t>(i), string(state.idOf(i)));
+            }
+        }
+    }
+    string path = room.flight.dump(roomId, roomFileName(roomId), reason, players);
+    if (!path.empty()) GLOWRACE_LOG(Warn) << "Wrote flight record for room " << roomId << " (" << reason << ") to " << path;
+}
+
+// Replaces a room's game with an empty one that is already over, dropping
+// whatever made it expensive. FastAPI deletes the room on the frame, and
+// players who come back start a new game. Called on the room's loop.
+void evictRoom(const string& roomId, Room& room) {
+    {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Evict, chrono::seconds(10));
+        if (!lock) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex to evict room " << roomId << " after 10 seconds";
+            return;
+        }
+        if (draining) return;
+        GameState empty(room.arena.room());
+        empty.setSeed(newRoomSeed(roomId));
+        empty.gameOver = true;
+        room.state = move(empty);
+        room.pendingInputCount = 0;
+        room.flight.dropInputs();
+        recordRoomState(roomId, room);
+    }
+    metrics::add(metrics::Counter::RoomEvictions);
+    GLOWRACE_LOG(Warn) << "Evicted room " << roomId << " after " << roomEvictAfter.count() << " s over its CPU budget";
+    sendGameState(roomId);
+}
+
+// A loop's view of its room's CPU budget
+struct CpuBudget {
+    double avgNs = 0; // Tick CPU, smoothed over the last five or so ticks
+    chrono::steady_clock::time_point throttledSince; // Unset while within budget
+};
+
+// Folds one tick's CPU into the room's budget and returns how long to wait
+// before the next tick. Throttling starts over the budget and ends under 80%
+// of it, so a room near the line does not flap. Called on the room's loop.
+chrono::steady_clock::duration nextTickInterval(const string& roomId, Room& room, CpuBudget& budget,
+                                                chrono::nanoseconds cpu, chrono::steady_clock::time_point now) {
+    if (roomCpuBudget.count() == 0) return kTickInterval;
+    budget.avgNs += 0.2 * (static_cast<double>(cpu.count()) - budget.avgNs);
+    double budgetNs = chrono::duration<double, nano>(roomCpuBudget).count();
+    bool throttled = budget.throttledSince != chrono::steady_clock::time_point();
+    if (budget.avgNs <= budgetNs && (!throttled || budget.avgNs < 0.8 * budgetNs)) {
+        if (throttled) {
+            GLOWRACE_LOG(Info) << "Room " << roomId << " is back within its CPU budget after "
+                               << chrono::duration_cast<chrono::seconds>(now - budget.throttledSince).count() << " s";
+            budget.throttledSince = {};
+            room.tickStats.throttlePercent.store(100, memory_order_relaxed);
+        }
+        return kTickInterval;
+    }
+    if (!throttled) {
+        budget.throttledSince = now;
+        metrics::add(metrics::Counter::RoomThrottles);
+        GLOWRACE_LOG(Warn) << "Throttling room " << roomId << ": tick CPU " << budget.avgNs / 1e6 << " ms against a "
+                           << budgetNs / 1e6 << " ms budget";
+        dumpFlight(roomId, room, "cpu_budget");
+    } else if (roomEvictAfter.count() > 0 && now - budget.throttledSince >= roomEvictAfter) {
+        evictRoom(roomId, room);
+        budget = {};
+        room.tickStats.throttlePercent.store(100, memory_order_relaxed);
+        return kTickInterval;
+    }
+    double factor = clamp(budget.avgNs / budgetNs, 1.0, kMaxThrottle);
+    room.tickStats.throttlePercent.store(static_cast<uint32_t>(factor * 100), memory_order_relaxed);
+    return chrono::duration_cast<chrono::steady_clock::duration>(kTickInterval * factor);
+}
+
+// Runs until the room has had no one alive for kParkAfter, or its rooms are
+// frozen, then removes itself from gameThreads; the next /update starts a
+// new loop
+void gameLoop(const string& roomId, Room* room, int gridSize) {
+    TickKernel kernel = useBitboardKernel ? findTickKernel(gridSize, edgeRule) : nullptr;
+    glowtrace::nameThread("room " + roomId);
+    auto idleSince = chrono::steady_clock::now();
+    chrono::steady_clock::time_point lastTick; // Unset while no one is alive
+    TickInputs consumed;
+    CpuBudget budget;
+    chrono::steady_clock::duration interval = kTickInterval; // Until the next tick; longer while throttled
+    while (true) {
+        int aliveCount = 0;
+        chrono::steady_clock::duration loopWait;
+        {
+            GLOWRACE_LOG(Trace) << "Acquiring mutex in gameLoop to read state for room " << roomId;
+            ProfiledLock lock(gameStateMutex, metrics::LockSite::GameLoop, chrono::seconds(10));
+            loopWait = lock.waited();
+            if (lock) {
+                GLOWRACE_LOG(Trace) << "Mutex acquired in gameLoop to read state for room " << roomId;
+                if (draining) {
+                    gameThreads[roomId].detach();
+                    gameThreads.erase(roomId);
+                    GLOWRACE_LOG(Info) << "Stopped game loop for room " << roomId << " for shutdown";
+                    return;
                 }
-                for (const auto& segment : state.players[j].tail) {
-                    if (currentPos.row == segment.row && currentPos.col == segment.col) {
-                        state.players[i].alive = false;
-                        for(auto ele: state.players[i].tail) {
-                            state.glowPoints.push_back(ele);
-                        }
-                        cout << "Player " << state.players[i].id << " collided with tail of player " << state.players[j].id << " at (" << segment.row << "," << segment.col << ")" << endl;
-                        state.players.erase(state.players.begin() + i);
-                    }
+                for (uint8_t a : room->state.alive) {
+                    if (a) aliveCount++;
                 }
+                auto now = chrono::steady_clock::now();
+                if (aliveCount > 0) {
+                    idleSince = now;
+                } else if (now - idleSince >= kParkAfter) {
+                    gameThreads[roomId].detach();
+                    gameThreads.erase(roomId);
+                    room->pendingInputCount = 0; // Nothing will move with them
+                    room->flight.dropInputs();
+                    GLOWRACE_LOG(Info) << "Parked game loop for room " << roomId;
+                    return;
+                }
+                GLOWRACE_LOG(Trace) << "Mutex released in gameLoop after read for room " << roomId;
+            } else {
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in gameLoop to read state for room " << roomId << " after 10 seconds";
+                dumpFlight(roomId, *room, "lock_timeout");
+                this_thread::sleep_for(kTickInterval);
+                continue;
+            }
+        }
+        if (aliveCount > 0) {
+            auto now = chrono::steady_clock::now();
+            flight::Tick& record = room->flight.begin(now);
+            record.loopWaitUs = flight::micros(loopWait);
+            if (lastTick != chrono::steady_clock::time_point()) {
+                auto lateness = now - lastTick - interval;
+                metrics::observe(metrics::Histogram::TickLatenessSeconds, lateness);
+                room->tickStats.lastLatenessNs.store(chrono::nanoseconds(lateness).count(), memory_order_relaxed);
+                record.latenessUs = static_cast<int32_t>(clamp<int64_t>(chrono::duration_cast<chrono::microseconds>(lateness).count(), INT32_MIN, INT32_MAX));
+            }
+            lastTick = now;
+            {
+                glowtrace::Span span("tick", roomId);
+                auto cpuStart = threadCpuTime();
+                gameTick(roomId, *room, kernel, consumed);
+                publishTick(roomId, *room, consumed);
+                auto cpu = threadCpuTime() - cpuStart;
+                room->tickStats.cpu.observe(cpu);
+                record.cpuUs = flight::micros(cpu);
+                interval = nextTickInterval(roomId, *room, budget, cpu, now);
+            }
+            if (chrono::steady_clock::now() - now > tickBudget) record.flags |= flight::Overrun;
+            if (record.flags & flight::LockTimeout) dumpFlight(roomId, *room, "lock_timeout");
+            else if (record.flags & flight::Overrun) dumpFlight(roomId, *room, "overrun");
+        } else {
+            lastTick = {};
+            interval = kTickInterval; // Nothing to throttle; the budget keeps its average for a rejoin
+        }
+        const char* reason;
+        if (flight::takeRequest(roomId, reason)) dumpFlight(roomId, *room, reason);
+        this_thread::sleep_for(interval);
+    }
+}
+
+// A loop thread started ahead of time; it sleeps until it is given a room
+void runSpareLoop(future<pair<string, Room*>> assignment) {
+    auto [roomId, room] = assignment.get();
+    gameLoop(roomId, room, boardSize);
+}
+
+// Tops the pool back up whenever something is taken from it
+void poolKeeper() {
+    while (true) {
+        size_t roomsWanted, loopsWanted;
+        {
+            unique_lock<mutex> lock(poolMutex);
+            poolLow.wait(lock, [] { return spareRooms.size() < roomPoolSize || spareLoops.size() < roomPoolSize; });
+            roomsWanted = roomPoolSize - spareRooms.size();
+            loopsWanted = roomPoolSize - spareLoops.size();
+        }
+        vector<unique_ptr<Room>> builtRooms;
+        vector<SpareLoop> builtLoops;
+        while (builtRooms.size() < roomsWanted) builtRooms.push_back(makeWarmRoom());
+        while (builtLoops.size() < loopsWanted) {
+            SpareLoop spare;
+            spare.worker = thread(runSpareLoop, spare.assignment.get_future());
+            builtLoops.push_back(move(spare));
+        }
+        lock_guard<mutex> lock(poolMutex);
+        for (auto& room : builtRooms) spareRooms.push_back(move(room));
+        for (auto& spare : builtLoops) spareLoops.push_back(move(spare));
+    }
+}
+
+// Starts the room's loop, on a spare thread if one is ready. Caller holds
+// gameStateMutex.
+void startLoop(const string& roomId, Room* room) {
+    unique_lock<mutex> lock(poolMutex);
+    if (spareLoops.empty()) {
+        lock.unlock();
+        gameThreads[roomId] = thread(gameLoop, roomId, room, boardSize);
+        return;
+    }
+    SpareLoop spare = move(spareLoops.back());
+    spareLoops.pop_back();
+    lock.unlock();
+    poolLow.notify_one();
+    gameThreads[roomId] = move(spare.worker);
+    spare.assignment.set_value({roomId, room});
+}
+
+// Starts a loop for every room with players alive that has none, returning
+// how many were started, and queues resets for games that ended before this
+// server could see them end. Caller holds gameStateMutex.
+size_t startRoomLoops() {
+    size_t loops = 0;
+    for (const auto& [roomId, room] : rooms) {
+        if (awaitingReset(room->state)) queueReset(roomId);
+        if (!hasAlivePlayers(room->state) || gameThreads.count(roomId)) continue;
+        startLoop(roomId, room.get());
+        loops++;
+    }
+    return loops;
+}
+
+// Encodes every room under the lock, then writes the file without it
+void checkpointRooms() {
+    auto start = chrono::steady_clock::now();
+    vector<CheckpointRoom> images;
+    {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Checkpoint, chrono::seconds(10));
+        if (!lock) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex for checkpoint after 10 seconds";
+            return;
+        }
+        images.reserve(rooms.size() + hibernatedRooms.size());
+        for (const auto& [roomId, room] : rooms) {
+            images.push_back({roomId, string()});
+            encodeSnapshot(room->state, boardSize, images.back().snapshot);
+        }
+        // Hibernated rooms are already encoded on disk
+        for (const string& roomId : hibernatedRooms) {
+            ifstream file(hibernationPath(roomId), ios::binary);
+            images.push_back({roomId, string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>())});
+        }
+    }
+    if (!writeCheckpoint(checkpointPath, boardSize, images)) {
+        GLOWRACE_LOG(Error) << "Failed to write checkpoint to " << checkpointPath;
+        return;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    GLOWRACE_LOG(Info) << "Checkpointed " << images.size() << " rooms to " << checkpointPath << " in " << ms << " ms";
+}
+
+// Maps the last checkpoint and brings every room in it back before the
+// server listens. Entries are checksummed and decoded in parallel, each into
+// its own arena; rooms with players alive get their loops started at once.
+void resumeFromCheckpoint() {
+    auto start = chrono::steady_clock::now();
+    MappedCheckpoint checkpoint;
+    string error;
+    if (!checkpoint.open(checkpointPath, boardSize, error)) {
+        GLOWRACE_LOG(Warn) << "Not resuming from checkpoint: " << error;
+        return;
+    }
+    size_t count = checkpoint.roomCount();
+    vector<unique_ptr<Room>> resumed(count);
+    unsigned workers = static_cast<unsigned>(min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(count, 1)));
+    vector<thread> validators;
+    for (unsigned w = 0; w < workers; ++w) {
+        validators.emplace_back([&checkpoint, &resumed, count, workers, w]() {
+            for (size_t i = w; i < count; i += workers) {
+                const char* data;
+                size_t size;
+                if (!checkpoint.snapshot(i, data, size)) continue;
+                auto room = make_unique<Room>();
+                if (decodeSnapshot(data, size, boardSize, room->state)) resumed[i] = move(room);
             }
+        });
+    }
+    for (thread& validator : validators) validator.join();
+
+    size_t invalid = 0;
+    lock_guard<timed_mutex> lock(gameStateMutex);
+    for (size_t i = 0; i < count; ++i) {
+        if (!resumed[i]) {
+            GLOWRACE_LOG(Warn) << "Skipping invalid checkpoint entry for room " << checkpoint.roomId(i);
+            invalid++;
+            continue;
         }
-        cout << "Self-collision check skipped for player " << state.players[i].id << endl;
+        string roomId(checkpoint.roomId(i));
+        Room* room = resumed[i].get();
+        rooms[roomId] = move(resumed[i]);
+        openReplayLog(roomId, *room);
+        openReplication(*room);
+        recordRoomState(roomId, *room);
     }
+    size_t loops = startRoomLoops();
+    auto age = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count() -
+               static_cast<int64_t>(checkpoint.writtenAtMs());
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    GLOWRACE_LOG(Info) << "Resumed " << (count - invalid) << " rooms (" << loops << " running, " << invalid << " invalid) from a "
+         << age << " ms old checkpoint in " << ms << " ms using " << workers << " threads";
 }
 
-void checkGameOver(GameState& state) {
-    int aliveCount = 0;
-    for (const auto& player : state.players) {
-        if (player.alive) aliveCount++;
+// Sends the follower a room's whole current state. A fresh writer drops any
+// actions still pending for the old stream; the state already includes them.
+// Caller holds gameStateMutex.
+void syncFollower(const string& roomId) {
+    auto it = rooms.find(roomId);
+    if (it != rooms.end()) {
+        Room& room = *it->second;
+        openReplication(room);
+        room.replication->recordState(room.state, boardSize);
+        replicate(roomId, room);
+    } else if (hibernatedRooms.count(roomId)) {
+        ifstream file(hibernationPath(roomId), ios::binary);
+        ReplayWriter writer;
+        writer.open(boardSize, edgeRule);
+        writer.recordImage(string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>()));
+        replicationLeader.send(roomId, writer.take());
     }
-    state.gameOver = (aliveCount == 0);
-    cout << "Checked game over: aliveCount=" << aliveCount << ", initialPlayerCount=" << state.initialPlayerCount << ", gameOver=" << state.gameOver << endl;
 }
 
-void gameTick(const string& roomId, int gridSize) {
-    cout << "Running gameTick for room " << roomId << endl;
-    if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-        lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-        cout << "Mutex acquired in gameTick for room " << roomId << endl;
+void startReplication(const string& path) {
+    replicating = true;
+    replicationLeader.onAttach = [](const function<void()>& attach) {
+        // Ticks replicate under the game lock, so none reaches the new
+        // follower ahead of its room's state
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Replication);
+        attach();
+        for (const auto& [roomId, room] : rooms) syncFollower(roomId);
+        for (const string& roomId : hibernatedRooms) syncFollower(roomId);
+        GLOWRACE_LOG(Info) << "Sent " << rooms.size() + hibernatedRooms.size() << " rooms to the follower";
+    };
+    replicationLeader.onResync = [](const string& roomId) {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Replication);
+        GLOWRACE_LOG(Info) << "Follower asked to resync room " << roomId;
+        syncFollower(roomId);
+    };
+    if (!replicationLeader.listen(path)) {
+        GLOWRACE_LOG(Error) << "Failed to listen for a replication follower on " << path;
+        replicating = false;
+        return;
+    }
+    GLOWRACE_LOG(Info) << "Replicating rooms to a follower on " << path;
+}
 
-        auto it = gameStates.find(roomId);
-        if (it != gameStates.end()) {
-            GameState& state = it->second;
-            for (auto& player : state.players) {
-                if (!player.alive) continue;
-                auto nextPos = getNextPosition(player, gridSize);
-                cout << "Moving player " << player.id << " from (" << player.head.row << "," << player.head.col << ") to (" << nextPos.row << "," << nextPos.col << ")" << endl;
-                player.tail.insert(player.tail.begin(), player.head);
-                if (player.tail.size() > static_cast<size_t>(player.score)) {
-                    player.tail.pop_back();
+// Mirrors the leader until its socket closes: states replace rooms, batches
+// are applied and ticked through the same code as the leader, and each tick's
+// checksum is compared. A room that disagrees is ignored until the leader
+// sends it again. A leader that hot-restarts says so first, and the follower
+// reconnects to its successor; one that dropped the follower is still
+// listening and is reconnected to. On return every room with players alive
+// is ticking.
+void followLeader(const string& path) {
+    ReplicationFollower follower;
+    GLOWRACE_LOG(Info) << "Following leader at " << path;
+    TickKernel kernel = useBitboardKernel ? findTickKernel(boardSize, edgeRule) : nullptr;
+    unordered_set<string> diverged;
+    long ticks = 0, mismatches = 0;
+    bool restarting = false;
+    auto onFrame = [&](const string& roomId, string_view payload) {
+        if (roomId.empty()) {
+            restarting = payload == "restarting";
+            return;
+        }
+        vector<ReplayRecord> records;
+        size_t consumed = 0;
+        string error;
+        if (!parseReplayRecords(payload.data(), payload.size(), records, consumed, error) || consumed != payload.size()) {
+            GLOWRACE_LOG(Warn) << "Unreadable replication frame for room " << roomId << ": " << error;
+            diverged.insert(roomId);
+            follower.requestResync(roomId);
+            return;
+        }
+        lock_guard<timed_mutex> lock(gameStateMutex);
+        for (const ReplayRecord& record : records) {
+            if (record.kind == ReplayRecord::Open) {
+                if (record.gridSize != boardSize || record.rule != edgeRule) {
+                    GLOWRACE_LOG(Warn) << "Leader runs a " << record.gridSize << " board with different rules; room " << roomId << " will not match";
+                }
+                continue;
+            }
+            auto it = rooms.find(roomId);
+            if (record.kind == ReplayRecord::State) {
+                if (restoreRoom(roomId, record.image)) {
+                    diverged.erase(roomId);
+                } else {
+                    GLOWRACE_LOG(Warn) << "Unreadable state from leader for room " << roomId;
+                    diverged.insert(roomId);
                 }
-                player.head = nextPos;
-                
-                for (auto it = state.glowPoints.begin(); it != state.glowPoints.end();) {
-                    if (player.head.row == it->row && player.head.col == it->col) {
-                        player.score++;
-                        cout << "Player " << player.id << " collected glow point at (" << it->row << "," << it->col << "), score: " << player.score << endl;
-                        it = state.glowPoints.erase(it);
-                        auto newGlowPos = getRandomPosition(gridSize, state);
-                        state.glowPoints.push_back(newGlowPos);
-                        cout << "Generated new glow point at (" << newGlowPos.row << "," << newGlowPos.col << ")" << endl;
-                    } else {
-                        ++it;
-                    }
+                continue;
+            }
+            if (it == rooms.end() || diverged.count(roomId)) continue;
+            Room& room = *it->second;
+            for (const Action& action : record.actions) applyRoomAction(room, action);
+            if (!record.ticked) continue;
+            uint64_t checksum = advanceRoom(roomId, room, kernel);
+            ticks++;
+            if (checksum != record.checksum) {
+                mismatches++;
+                diverged.insert(roomId);
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "Checksum mismatch in room " << roomId << "; asking the leader to resync it";
+                follower.requestResync(roomId);
+            }
+        }
+    };
+    bool connected = false;
+    while (true) {
+        if (!connected) follower.connect(path);
+        GLOWRACE_LOG(Info) << "Connected to leader at " << path;
+        restarting = false;
+        follower.follow(onFrame);
+        // The successor sends every room again once it accepts us
+        if (restarting) {
+            GLOWRACE_LOG(Info) << "Leader is handing over to a new process; reconnecting";
+            connected = false;
+            continue;
+        }
+        // A leader still listening dropped us for falling behind, and sends every room again too
+        connected = follower.tryConnect(path);
+        if (!connected) break;
+        GLOWRACE_LOG(Warn) << "Leader dropped this follower; reconnected to resync";
+    }
+
+    auto start = chrono::steady_clock::now();
+    lock_guard<timed_mutex> lock(gameStateMutex);
+    size_t loops = startRoomLoops();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    GLOWRACE_LOG(Info) << "Leader gone after " << ticks << " mirrored ticks (" << mismatches << " mismatches); took over "
+         << rooms.size() << " rooms (" << loops << " running, " << diverged.size() << " unsynced) in " << ms << " ms";
+}
+
+// Runs a request that reached this process after its rooms were frozen on
+// the successor instead, and copies its response back. With no successor,
+// i.e. while shutting down, the request is turned away.
+void forwardRequest(char kind, const string& body, Response& res) {
+    lock_guard<mutex> lock(successorMutex);
+    string frame, tag, reply;
+    appendFrame(frame, "", string(1, kind) + body);
+    if (successorFd < 0 || !writeAll(successorFd, frame.data(), frame.size()) || !successorReader->next(tag, reply) ||
+        reply.size() < 3) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Turning away a request while " << (successorFd < 0 ? "shutting down" : "handing over");
+        res.status = 503;
+        res.set_content("{\"error\":\"Server restarting\"}", "application/json");
+        return;
+    }
+    res.status = atoi(reply.substr(0, 3).c_str());
+    res.set_content(reply.substr(3), "application/json");
+}
+
+void handleUpdate(const Request& req, Response& res) {
+    GLOWRACE_LOG(Debug) << "Received action: " << req.body;
+    glowtrace::Span span("update");
+    // Times each phase for /metrics and, with tracing on, the timeline
+    auto phaseStart = chrono::steady_clock::now();
+    auto ingress = phaseStart;
+    auto endPhase = [&phaseStart](metrics::Histogram histogram, const char* traceName) {
+        auto now = chrono::steady_clock::now();
+        metrics::observe(histogram, now - phaseStart);
+        if (traceName && glowtrace::enabled()) glowtrace::record(traceName, phaseStart, now);
+        phaseStart = now;
+    };
+    string updatedState;
+    try {
+        UpdateRequest request = parseUpdateRequest(req.body);
+        const Action& action = request.action;
+        const string& playerId = action.playerId;
+        const string& roomId = request.roomId;
+        bool valid = request.valid;
+        if (roomId.empty()) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Error: room_id is required";
+            res.status = 400;
+            res.set_content("{\"error\":\"room_id is required\"}", "application/json");
+            return;
+        }
+        GLOWRACE_LOG(Debug) << "Processing action type: " << request.actionType << " for player: " << playerId << " in room: " << roomId;
+
+        // FastAPI's stamp, in Unix milliseconds, when the player's input reached it
+        int64_t forwardNs = -1;
+        if (double receivedAtMs = request.receivedAtMs; receivedAtMs > 0) {
+            auto sinceEpoch = chrono::system_clock::now().time_since_epoch() - (chrono::steady_clock::now() - ingress);
+            double ns = (chrono::duration<double, milli>(sinceEpoch).count() - receivedAtMs) * 1e6;
+            if (ns >= 0) forwardNs = static_cast<int64_t>(ns); // Otherwise the clocks disagree
+        }
+
+        // Unknown actions and directions still create the room but apply nothing
+        if (!valid) {
+            GLOWRACE_LOG(Debug) << "Ignoring unknown action '" << request.actionType << "' for player " << playerId;
+        }
+
+        GLOWRACE_LOG(Trace) << "Acquiring mutex in /update for room " << roomId;
+        span.setArg(roomId);
+        endPhase(metrics::Histogram::UpdateParseSeconds, "parse");
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Update, chrono::seconds(10));
+        endPhase(metrics::Histogram::UpdateLockWaitSeconds, nullptr); // ProfiledLock traces contended waits
+        if (lock) {
+            if (draining) {
+                lock.unlock();
+                forwardRequest('U', req.body, res);
+                return;
+            }
+            GLOWRACE_LOG(Trace) << "Mutex acquired in /update for room " << roomId;
+            Room* room = residentRoom(roomId);
+            if (!room) {
+                room = createRoom(roomId);
+                uint64_t seed = newRoomSeed(roomId);
+                room->state = loadGameState(roomId, seed, room->arena.room());
+                recordRoomState(roomId, *room);
+                GLOWRACE_LOG(Info) << "Initialized new game state for room " << roomId << " with seed " << seed;
+            }
+            room->lastActive = chrono::steady_clock::now();
+            // Start game loop for a new or parked room
+            if (gameThreads.find(roomId) == gameThreads.end()) {
+                startLoop(roomId, room);
+                GLOWRACE_LOG(Info) << "Started game loop for room " << roomId;
+            }
+            GameState& state = room->state;
+            if (valid) {
+                bool wasOver = state.gameOver;
+                ActionResult result = applyRoomAction(*room, action);
+                int index = state.findPlayer(playerId);
+                room->inputsSinceTick++;
+                room->flight.noteInput(index, action, result, chrono::steady_clock::now());
+                if (!wasOver && state.gameOver) queueReset(roomId);
+                // Timed until the first frame that moves with it
+                bool moves = result == ActionResult::Added || result == ActionResult::Rejoined || result == ActionResult::Turned;
+                if (moves && room->pendingInputCount < kMaxPendingInputs) {
+                    room->pendingInputs[room->pendingInputCount++] = {ingress, chrono::steady_clock::now(), forwardNs};
+                    if (!room->inputLatency) room->inputLatency = make_unique<InputLatency>();
                 }
-                if(state.glowPoints.size() == 0) {
-                    auto newGlowPos = getRandomPosition(gridSize, state);
-                    state.glowPoints.push_back(newGlowPos);
+                switch (result) {
+                    case ActionResult::Added:
+                        GLOWRACE_LOG(Info) << "Added player: " << playerId << " with name: " << action.name
+                             << " at (" << state.heads[index].row << "," << state.heads[index].col << ")"
+                             << " direction: " << directionName(state.directions[index]) << " in room " << roomId;
+                        break;
+                    case ActionResult::Rejoined:
+                        GLOWRACE_LOG(Info) << "Player " << playerId << " reset at (" << state.heads[index].row << "," << state.heads[index].col << ")"
+                             << " direction: " << directionName(state.directions[index]) << " in room " << roomId;
+                        break;
+                    case ActionResult::Turned:
+                        GLOWRACE_LOG(Debug) << "Changed direction for player " << playerId << " to " << directionName(action.direction) << " in room " << roomId;
+                        break;
+                    case ActionResult::Ended:
+                        GLOWRACE_LOG(Info) << "Player " << playerId << " ended their game in room " << roomId;
+                        break;
+                    case ActionResult::Ignored:
+                        break;
                 }
             }
-            checkCollisions(state, gridSize);
-            checkGameOver(state);
+            updatedState = gameStateToJson(state);
+            lock.unlock();
+            endPhase(metrics::Histogram::UpdateApplySeconds, "apply");
+            GLOWRACE_LOG(Trace) << "Mutex released in /update for room " << roomId;
         } else {
-            cout << "No game state found for room " << roomId << " in gameTick" << endl;
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /update for room " << roomId << " after 10 seconds";
+            flight::requestDump(roomId, "update_503");
+            res.status = 503;
+            res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
+            return;
         }
-        cout << "Mutex released in gameTick for room " << roomId << endl;
-    } else {
-        cout << "Failed to acquire mutex in gameTick for room " << roomId << " after 10 seconds" << endl;
+        sendGameState(roomId);
+        GLOWRACE_LOG(Debug) << "Sending updated state for room " << roomId << ": " << updatedState;
+        res.set_content(updatedState, "application/json");
+        endPhase(metrics::Histogram::UpdateRespondSeconds, "respond");
+    } catch (const json::exception& e) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Error parsing action JSON for room: " << e.what();
+        res.status = 400;
+        res.set_content("{\"error\":\"Invalid JSON\"}", "application/json");
+    } catch (const std::exception& e) {
+        GLOWRACE_LOG(Error) << "Error processing action for room: " << e.what();
+        res.status = 500;
+        res.set_content("{\"error\":\"Server error\"}", "application/json");
+    } catch (...) {
+        GLOWRACE_LOG(Error) << "Unknown error processing action for room";
+        res.status = 500;
+        res.set_content("{\"error\":\"Unknown server error\"}", "application/json");
     }
 }
 
-bool shouldResetGameState(const GameState& state) {
-    if (state.players.empty()) return true;
-    bool allDead = true;
-    for (const auto& player : state.players) {
-        if (player.alive) {
-            allDead = false;
-            break;
+void handleReset(const Request& req, Response& res) {
+    GLOWRACE_LOG(Debug) << "Received reset request";
+    string updatedState;
+    string roomId = req.has_param("room_id") ? req.get_param_value("room_id") : "";
+    if (roomId.empty()) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Error: room_id is required";
+        res.status = 400;
+        res.set_content("{\"error\":\"room_id is required\"}", "application/json");
+        return;
+    }
+    GLOWRACE_LOG(Trace) << "Acquiring mutex in /reset for room " << roomId;
+    ProfiledLock lock(gameStateMutex, metrics::LockSite::Reset, chrono::seconds(10));
+    if (lock) {
+        if (draining) {
+            lock.unlock();
+            forwardRequest('R', roomId, res);
+            return;
         }
+        GLOWRACE_LOG(Trace) << "Mutex acquired in /reset for room " << roomId;
+        Room* room = residentRoom(roomId);
+        if (!room) room = createRoom(roomId);
+        room->lastActive = chrono::steady_clock::now();
+        room->state = loadGameState(roomId, newRoomSeed(roomId), room->arena.room()); // Reset to loaded state
+        room->pendingInputCount = 0;
+        recordRoomState(roomId, *room);
+        updatedState = gameStateToJson(room->state);
+        GLOWRACE_LOG(Info) << "Game state reset for room " << roomId << ": " << updatedState;
+        GLOWRACE_LOG(Trace) << "Mutex released in /reset for room " << roomId;
+    } else {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /reset for room " << roomId << " after 10 seconds";
+        flight::requestDump(roomId, "reset_503");
+        res.status = 503;
+        res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
+        return;
     }
-    return allDead;
+    res.set_content(updatedState, "application/json");
 }
 
-void resetPlayerState(Player& player, int gridSize) {
-    player.head = getRandomPosition(gridSize, GameState());
-    player.tail.clear();
-    player.direction = getRandomDirection();
-    player.score = 0;
-    player.alive = true;
+// FastAPI calls this as it creates a room, so the room is known to be empty:
+// it comes from the pool with no /load_state round trip, and gets a loop
+// once someone joins. A room that already exists is left as it is.
+void handleCreateRoom(const Request& req, Response& res) {
+    string roomId = req.has_param("room_id") ? req.get_param_value("room_id") : "";
+    if (roomId.empty()) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Error: room_id is required";
+        res.status = 400;
+        res.set_content("{\"error\":\"room_id is required\"}", "application/json");
+        return;
+    }
+    ProfiledLock lock(gameStateMutex, metrics::LockSite::CreateRoom, chrono::seconds(10));
+    if (!lock) {
+        GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /create_room for room " << roomId << " after 10 seconds";
+        res.status = 503;
+        res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
+        return;
+    }
+    if (draining) {
+        lock.unlock();
+        forwardRequest('C', roomId, res);
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    Room* room = residentRoom(roomId);
+    bool created = room == nullptr;
+    if (created) {
+        room = createRoom(roomId);
+        room->state.setSeed(newRoomSeed(roomId));
+        recordRoomState(roomId, *room);
+    }
+    string state = gameStateToJson(room->state);
+    lock.unlock();
+    if (created) {
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        GLOWRACE_LOG(Info) << "Created room " << roomId << " in " << us << " us";
+    } else {
+        GLOWRACE_LOG(Debug) << "Room " << roomId << " already exists";
+    }
+    res.set_content(state, "application/json");
 }
 
-void gameLoop(const string& roomId, int gridSize) {
-    while (true) {
-        bool gameOver = false;
-        int aliveCount = 0;
+// Freezes every room and sends it to the successor connected on fd, then
+// waits for the successor to bind port 9000. On success the main loop drains
+// and exits; on failure the rooms are unfrozen and this server carries on.
+bool handOff(int fd) {
+    auto start = chrono::steady_clock::now();
+    lock_guard<mutex> forwarding(successorMutex); // Held until the successor listens
+    timeval timeout{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    string frames;
+    size_t count;
+    {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Handoff);
+        draining = true;
+        // The successor appends to the same replay logs as soon as it has the
+        // rooms, so everything recorded here must be on disk first
         {
-            cout << "Acquiring mutex in gameLoop to read state for room " << roomId << endl;
-            if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-                lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-                cout << "Mutex acquired in gameLoop to read state for room " << roomId << endl;
-                auto it = gameStates.find(roomId);
-                if (it != gameStates.end()) {
-                    gameOver = it->second.gameOver;
-                    for (const auto& player : it->second.players) {
-                        if (player.alive) aliveCount++;
-                    }
+            lock_guard<mutex> replayWriting(replayWriteMutex);
+            for (const auto& [roomId, room] : rooms) {
+                if (room->replay && !room->replay->empty()) writeReplay(room->replayFd, room->replay->take());
+            }
+        }
+        for (const auto& [roomId, room] : rooms) {
+            ReplayWriter writer;
+            writer.open(boardSize, edgeRule);
+            writer.recordState(room->state, boardSize);
+            appendFrame(frames, roomId, writer.take());
+        }
+        for (const string& roomId : hibernatedRooms) {
+            ifstream file(hibernationPath(roomId), ios::binary);
+            ReplayWriter writer;
+            writer.open(boardSize, edgeRule);
+            writer.recordImage(string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>()));
+            appendFrame(frames, roomId, writer.take());
+        }
+        count = rooms.size() + hibernatedRooms.size();
+    }
+    appendFrame(frames, "", "ready");
+    successorFd = fd;
+    successorReader = make_unique<FrameReader>(fd);
+    string tag, reply;
+    if (writeAll(fd, frames.data(), frames.size()) && successorReader->next(tag, reply) && reply == "listening") {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Handoff);
+        // The successor holds these rooms in memory now
+        for (const string& roomId : hibernatedRooms) filesystem::remove(hibernationPath(roomId));
+        hibernatedRooms.clear();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        GLOWRACE_LOG(Info) << "Handed " << count << " rooms (" << frames.size() << " bytes) to the successor in " << ms << " ms; draining";
+        shutdownRequested = true;
+        return true;
+    }
+    successorReader.reset();
+    successorFd = -1;
+    close(fd);
+    ProfiledLock lock(gameStateMutex, metrics::LockSite::Handoff);
+    draining = false;
+    size_t loops = startRoomLoops();
+    GLOWRACE_LOG(Warn) << "Handoff failed; resumed " << count << " rooms (" << loops << " running)";
+    return false;
+}
+
+// Waits on the handoff socket for the next server to start and hands the
+// rooms to it. Runs for the life of the process until a handoff succeeds.
+void startHandoffListener() {
+    int listener = listenUnixSocket(handoffPath);
+    if (listener < 0) {
+        GLOWRACE_LOG(Error) << "Failed to listen for a hot-restart successor on " << handoffPath;
+        return;
+    }
+    GLOWRACE_LOG(Info) << "Waiting for a hot-restart successor on " << handoffPath;
+    thread([listener]() {
+        while (true) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                GLOWRACE_LOG(Error) << "Handoff accept failed: " << strerror(errno);
+                return;
+            }
+            GLOWRACE_LOG(Info) << "Hot-restart successor connected";
+            if (handOff(fd)) break;
+        }
+        close(listener);
+    }).detach();
+}
+
+// Restores every room the predecessor sends, up to its "ready" frame, and
+// starts their loops. False if the predecessor went away first.
+bool takeOverFrom(FrameReader& predecessor) {
+    auto start = chrono::steady_clock::now();
+    size_t restored = 0, unreadable = 0;
+    string roomId, payload;
+    lock_guard<timed_mutex> lock(gameStateMutex);
+    while (predecessor.next(roomId, payload)) {
+        if (roomId.empty()) {
+            if (payload != "ready") continue;
+            size_t loops = startRoomLoops();
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            GLOWRACE_LOG(Info) << "Took over " << restored << " rooms (" << loops << " running, " << unreadable << " unreadable) from the previous server in " << ms << " ms";
+            return true;
+        }
+        vector<ReplayRecord> records;
+        size_t consumed = 0;
+        string error;
+        if (!parseReplayRecords(payload.data(), payload.size(), records, consumed, error) || consumed != payload.size()) {
+            GLOWRACE_LOG(Warn) << "Unreadable handoff frame for room " << roomId << ": " << error;
+            unreadable++;
+            continue;
+        }
+        for (const ReplayRecord& record : records) {
+            if (record.kind == ReplayRecord::Open && (record.gridSize != boardSize || record.rule != edgeRule)) {
+                GLOWRACE_LOG(Warn) << "Previous server ran a " << record.gridSize << " board with different rules; room " << roomId << " may not load";
+            } else if (record.kind == ReplayRecord::State) {
+                if (restoreRoom(roomId, record.image)) {
+                    restored++;
+                } else {
+                    GLOWRACE_LOG(Warn) << "Unreadable state for room " << roomId << " from the previous server";
+                    unreadable++;
                 }
-                cout << "Mutex released in gameLoop after read for room " << roomId << endl;
-            } else {
-                cout << "Failed to acquire mutex in gameLoop to read state for room " << roomId << " after 10 seconds" << endl;
-                this_thread::sleep_for(chrono::milliseconds(200));
-                continue;
             }
         }
-        if (aliveCount > 0) {
-            gameTick(roomId, gridSize);
-            sendGameState(roomId);
+    }
+    return false;
+}
+
+// Serves the requests the predecessor forwards while it drains. Once it has
+// exited this server waits for a successor of its own.
+void serveForwardedRequests(unique_ptr<FrameReader> predecessor, int fd) {
+    string tag, request;
+    size_t forwarded = 0;
+    while (predecessor->next(tag, request)) {
+        if (request.empty()) continue;
+        Request req;
+        Response res;
+        if (request[0] == 'U') {
+            req.body = request.substr(1);
+            handleUpdate(req, res);
+        } else {
+            req.params.emplace("room_id", request.substr(1));
+            if (request[0] == 'C') {
+                handleCreateRoom(req, res);
+            } else {
+                handleReset(req, res);
+            }
         }
-        this_thread::sleep_for(chrono::milliseconds(200));
+        string frame;
+        appendFrame(frame, "", to_string(res.status > 0 ? res.status : 200) + res.body);
+        writeAll(fd, frame.data(), frame.size());
+        forwarded++;
     }
+    close(fd);
+    GLOWRACE_LOG(Info) << "Previous server exited after forwarding " << forwarded << " requests";
+    startHandoffListener();
+}
+
+void requestShutdown(int) {
+    shutdownRequested = true;
 }
 
 int main() {
     Server svr;
 
+    if (const char* kernel = getenv("GLOWRACE_TICK_KERNEL")) {
+        useBitboardKernel = string(kernel) == "bitboard";
+    }
+    if (const char* size = getenv("GLOWRACE_GRID_SIZE")) {
+        boardSize = max(1, atoi(size));
+        if (boardSize > kMaxGridSize) {
+            GLOWRACE_LOG(Warn) << "GLOWRACE_GRID_SIZE " << boardSize << " exceeds this build's limit of " << kMaxGridSize
+                 << " (GLOWRACE_MAX_GRID), using " << kMaxGridSize;
+            boardSize = kMaxGridSize;
+        }
+    }
+    if (const char* rule = getenv("GLOWRACE_EDGE_RULE")) {
+        edgeRule = string(rule) == "walls" ? EdgeRule::Walls : EdgeRule::Wrap;
+    }
+    if (const char* backend = getenv("GLOWRACE_BACKEND")) {
+        string address = backend;
+        size_t colon = address.rfind(':');
+        backendHost = address.substr(0, colon);
+        if (colon != string::npos) backendPort = atoi(address.c_str() + colon + 1);
+    }
+    if (const char* budget = getenv("GLOWRACE_MEMORY_BUDGET_MB")) {
+        memoryBudget = static_cast<size_t>(max(0, atoi(budget))) << 20;
+    }
+    if (const char* dir = getenv("GLOWRACE_HIBERNATE_DIR")) {
+        hibernateDir = dir;
+    }
+    // A server still waiting on the handoff socket is about to hand its rooms over
+    int predecessorFd = -1;
+    if (const char* path = getenv("GLOWRACE_HANDOFF")) {
+        handoffPath = path;
+        predecessorFd = connectUnixSocket(handoffPath);
+    }
+    if (memoryBudget > 0) {
+        // Snapshots left by an earlier process are stale; its rooms come back through /load_state.
+        // A predecessor still owns its snapshots and sends them over itself.
+        filesystem::create_directories(hibernateDir);
+        for (const auto& entry : filesystem::directory_iterator(hibernateDir)) {
+            if (predecessorFd < 0 && entry.path().extension() == ".room") filesystem::remove(entry.path());
+        }
+        GLOWRACE_LOG(Info) << "Hibernating parked rooms to " << hibernateDir << " above " << (memoryBudget >> 20) << " MB resident";
+    }
+    if (const char* size = getenv("GLOWRACE_ROOM_POOL")) {
+        roomPoolSize = static_cast<size_t>(max(0, atoi(size)));
+    }
+    if (roomPoolSize > 0) thread(poolKeeper).detach();
+    if (const char* budget = getenv("GLOWRACE_TICK_BUDGET_MS")) {
+        tickBudget = chrono::milliseconds(max(1, atoi(budget)));
+    }
+    if (const char* budget = getenv("GLOWRACE_ROOM_CPU_BUDGET_MS")) {
+        roomCpuBudget = chrono::microseconds(static_cast<int64_t>(max(0.0, atof(budget)) * 1000));
+    }
+    if (const char* evict = getenv("GLOWRACE_ROOM_EVICT_SECS")) {
+        roomEvictAfter = chrono::seconds(max(0, atoi(evict)));
+    }
+    if (const char* dir = getenv("GLOWRACE_FLIGHT_DIR")) {
+        flight::setDirectory(dir);
+    }
+    if (const char* trace = getenv("GLOWRACE_TRACE")) {
+        glowtrace::setEnabled(string(trace) == "1");
+    }
+    if (const char* dir = getenv("GLOWRACE_REPLAY_DIR")) {
+        replayDir = dir;
+        filesystem::create_directories(replayDir);
+        GLOWRACE_LOG(Info) << "Writing replay logs to " << replayDir;
+    }
+    if (const char* path = getenv("GLOWRACE_CHECKPOINT")) {
+        checkpointPath = path;
+    }
+    if (const char* seconds = getenv("GLOWRACE_CHECKPOINT_SECS")) {
+        checkpointEvery = chrono::seconds(max(1, atoi(seconds)));
+    }
+    bool specialized = useBitboardKernel && findTickKernel(boardSize, edgeRule) != nullptr;
+    GLOWRACE_LOG(Info) << "Board " << boardSize << "x" << boardSize << (edgeRule == EdgeRule::Walls ? " with walls" : " wrapping")
+         << ", tick kernel: " << (specialized ? "bitboard" : "reference");
+
     svr.Get("/", [](const Request& req, Response& res) {
         res.set_content("C++ Server Running", "text/plain");
     });
 
-    svr.Post("/update", [](const Request& req, Response& res) {
-        cout << "Received action: " << req.body << endl;
-        string updatedState;
-        try {
-            json actionJson = json::parse(req.body);
-            string actionType = actionJson["action"];
-            string playerId = actionJson["playerId"];
-            string roomId = actionJson.value("room_id", "");
-            if (roomId.empty()) {
-                cout << "Error: room_id is required" << endl;
-                res.status = 400;
-                res.set_content("{\"error\":\"room_id is required\"}", "application/json");
-                return;
-            }
-            cout << "Processing action type: " << actionType << " for player: " << playerId << " in room: " << roomId << endl;
-
-            cout << "Acquiring mutex in /update for room " << roomId << endl;
-            if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-                lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-                cout << "Mutex acquired in /update for room " << roomId << endl;
-                auto it = gameStates.find(roomId);
-                if (it == gameStates.end()) {
-                    gameStates[roomId] = loadGameState(roomId);
-                    cout << "Initialized new game state for room " << roomId << endl;
-                    // Start game loop for new room
-                    if (gameThreads.find(roomId) == gameThreads.end()) {
-                        gameThreads[roomId] = thread(gameLoop, roomId, 50);
-                        cout << "Started game loop for room " << roomId << endl;
-                    }
-                }
-                GameState& state = gameStates[roomId];
-                if (actionType == "addPlayer") {
-                    bool playerExists = false;
-                    cout << "Checking if player exists in room " << roomId << endl;
-                    for (const auto& player : state.players) {
-                        if (player.id == playerId) {
-                            playerExists = true;
-                            cout << "Player " << playerId << " already exists in room " << roomId << endl;
-                            break;
-                        }
-                    }
-                    if (!playerExists) {
-                        cout << "Adding new player to room " << roomId << endl;
-                        string playerName = actionJson.value("name", "Player " + playerId);
-                        Position startPos = getRandomPosition(50, state);
-                        string startDirection = getRandomDirection();
-                        state.players.push_back({playerId, playerName, startPos, {}, startDirection, 0, true});
-                        state.initialPlayerCount = state.players.size();
-                        cout << "Added player: " << playerId << " with name: " << playerName 
-                             << " at (" << startPos.row << "," << startPos.col << ")" 
-                             << " direction: " << startDirection << " in room " << roomId << endl;
-                    } else if (state.gameOver) {
-                        for (auto& player : state.players) {
-                            if (player.id == playerId) {
-                                resetPlayerState(player, 50);
-                                cout << "Player " << playerId << " reset at (" << player.head.row << "," << player.head.col << ")" 
-                                     << " direction: " << player.direction << " in room " << roomId << endl;
-                                break;
-                            }
-                        }
-                        state.gameOver = false;
-                        checkGameOver(state);
-                    }
-                } else if (actionType == "changeDirection") {
-                    string direction = actionJson["direction"];
-                    for (auto& player : state.players) {
-                        if (player.id == playerId) {
-                            player.direction = direction;
-                            cout << "Changed direction for player " << playerId << " to " << direction << " in room " << roomId << endl;
-                            break;
-                        }
-                    }
-                } else if (actionType == "endGame") {
-                    for (auto& player : state.players) {
-                        if (player.id == playerId) {
-                            player.alive = false;
-                            cout << "Player " << playerId << " ended their game in room " << roomId << endl;
-                            break;
-                        }
-                    }
-                    checkGameOver(state);
-                }
-                updatedState = gameStateToJson(state);
-                cout << "Mutex released in /update for room " << roomId << endl;
-            } else {
-                cout << "Failed to acquire mutex in /update for room " << roomId << " after 10 seconds" << endl;
-                res.status = 503;
-                res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
-                return;
-            }
-            sendGameState(roomId);
-            cout << "Sending updated state for room " << roomId << ": " << updatedState << endl;
-            res.set_content(updatedState, "application/json");
-        } catch (const json::exception& e) {
-            cout << "Error parsing action JSON for room: " << e.what() << endl;
-            res.status = 400;
-            res.set_content("{\"error\":\"Invalid JSON\"}", "application/json");
-        } catch (const std::exception& e) {
-            cout << "Error processing action for room: " << e.what() << endl;
-            res.status = 500;
-            res.set_content("{\"error\":\"Server error\"}", "application/json");
-        } catch (...) {
-            cout << "Unknown error processing action for room" << endl;
-            res.status = 500;
-            res.set_content("{\"error\":\"Unknown server error\"}", "application/json");
+    svr.Post("/update", handleUpdate);
+
+    // Heap bytes each resident room holds, for sizing hosts by room count,
+    // and how many rooms are hibernated
+    svr.Get("/memory", [](const Request& req, Response& res) {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Memory, chrono::seconds(10));
+        if (!lock) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /memory after 10 seconds";
+            res.status = 503;
+            res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
+            return;
+        }
+        json report = {{"rooms", json::array()}};
+        size_t total = 0;
+        for (const auto& [roomId, room] : rooms) {
+            size_t bytes = room->bytesResident();
+            total += bytes;
+            report["rooms"].push_back({{"room_id", roomId}, {"players", room->state.playerCount()}, {"bytes", bytes}});
         }
+        report["total_bytes"] = total;
+        report["budget_bytes"] = memoryBudget;
+        report["resident_rooms"] = rooms.size();
+        report["hibernated_rooms"] = hibernatedRooms.size();
+        {
+            lock_guard<mutex> pool(poolMutex);
+            report["spare_rooms"] = spareRooms.size();
+            report["spare_loops"] = spareLoops.size();
+        }
+        report["reloads"] = reloadStats.count;
+        report["reload_ms"] = {{"last", reloadStats.lastMs},
+                               {"avg", reloadStats.count ? reloadStats.totalMs / reloadStats.count : 0.0},
+                               {"max", reloadStats.maxMs}};
+        res.set_content(report.dump(), "application/json");
     });
 
-    svr.Post("/reset", [](const Request& req, Response& res) {
-        cout << "Received reset request" << endl;
-        string updatedState;
-        string roomId = req.has_param("room_id") ? req.get_param_value("room_id") : "";
-        if (roomId.empty()) {
-            cout << "Error: room_id is required" << endl;
+    // Every room and what it costs, most expensive first, to find the few
+    // pathological rooms on a hot box without a debugger. ?sort= picks the
+    // cost: cpu (average tick CPU, the default), cpu_max, lateness, bytes,
+    // segments, glow, players, inputs, publish or throttle (how many times
+    // slower than normal an over-budget room ticks). ?limit=N keeps the top N.
+    svr.Get("/rooms", [](const Request& req, Response& res) {
+        struct Row {
+            string roomId;
+            const char* state;
+            size_t players = 0, alive = 0, segments = 0, glow = 0, bytes = 0, inputs = 0;
+            uint64_t ticks = 0;
+            double cpuAvgMs = 0, cpuP99Ms = 0, cpuMaxMs = 0, latenessMs = 0, publishBacklogMs = 0, lastPublishMs = 0;
+            double throttle = 1;
+        };
+        using SortKey = double (*)(const Row&);
+        static const unordered_map<string, SortKey> sortKeys = {
+            {"cpu", [](const Row& r) { return r.cpuAvgMs; }},
+            {"cpu_max", [](const Row& r) { return r.cpuMaxMs; }},
+            {"lateness", [](const Row& r) { return r.latenessMs; }},
+            {"bytes", [](const Row& r) { return static_cast<double>(r.bytes); }},
+            {"segments", [](const Row& r) { return static_cast<double>(r.segments); }},
+            {"glow", [](const Row& r) { return static_cast<double>(r.glow); }},
+            {"players", [](const Row& r) { return static_cast<double>(r.players); }},
+            {"inputs", [](const Row& r) { return static_cast<double>(r.inputs); }},
+            {"publish", [](const Row& r) { return r.publishBacklogMs; }},
+            {"throttle", [](const Row& r) { return r.throttle; }},
+        };
+        string sortBy = req.has_param("sort") ? req.get_param_value("sort") : "cpu";
+        auto key = sortKeys.find(sortBy);
+        if (key == sortKeys.end()) {
             res.status = 400;
-            res.set_content("{\"error\":\"room_id is required\"}", "application/json");
+            res.set_content("{\"error\":\"Unknown sort\"}", "application/json");
             return;
         }
-        cout << "Acquiring mutex in /reset for room " << roomId << endl;
-        if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-            lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-            cout << "Mutex acquired in /reset for room " << roomId << endl;
-            auto it = gameStates.find(roomId);
-            if (it != gameStates.end()) {
-                it->second = loadGameState(roomId); // Reset to loaded state
-            } else {
-                gameStates[roomId] = loadGameState(roomId);
+        size_t limit = req.has_param("limit") ? static_cast<size_t>(max(0, atoi(req.get_param_value("limit").c_str()))) : SIZE_MAX;
+
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Rooms, chrono::seconds(10));
+        if (!lock) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /rooms after 10 seconds";
+            res.status = 503;
+            res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
+            return;
+        }
+        int64_t nowNs = chrono::nanoseconds(chrono::steady_clock::now().time_since_epoch()).count();
+        vector<Row> rows;
+        rows.reserve(rooms.size() + hibernatedRooms.size());
+        {
+            lock_guard<mutex> resets(resetMutex);
+            for (const auto& [roomId, room] : rooms) {
+                Row row;
+                row.roomId = roomId;
+                const GameState& state = room->state;
+                for (size_t i = 0; i < state.slotCount(); ++i) {
+                    if (!state.occupied[i]) continue;
+                    row.players++;
+                    if (state.alive[i]) row.alive++;
+                    row.segments += state.body(i).size();
+                }
+                row.glow = state.glowPoints.size();
+                row.bytes = room->bytesResident();
+                row.inputs = room->inputsSinceTick;
+                row.ticks = room->ticks;
+                const TickStats& stats = room->tickStats;
+                uint64_t measured = stats.cpu.count();
+                if (measured > 0) row.cpuAvgMs = stats.cpu.sumNs.load(memory_order_relaxed) / 1e6 / measured;
+                row.cpuP99Ms = stats.cpu.quantileSeconds(0.99) * 1e3;
+                row.cpuMaxMs = stats.cpu.maxNs.load(memory_order_relaxed) / 1e6;
+                row.latenessMs = stats.lastLatenessNs.load(memory_order_relaxed) / 1e6;
+                int64_t publishingSince = stats.publishingSinceNs.load(memory_order_relaxed);
+                if (publishingSince > 0) row.publishBacklogMs = (nowNs - publishingSince) / 1e6;
+                row.lastPublishMs = stats.lastPublishNs.load(memory_order_relaxed) / 1e6;
+                row.throttle = stats.throttlePercent.load(memory_order_relaxed) / 100.0;
+                if (queuedResets.count(roomId)) row.state = "resetting";
+                else if (gameThreads.count(roomId) && row.alive > 0) row.state = row.throttle > 1 ? "throttled" : "live";
+                else if (gameThreads.count(roomId)) row.state = "idle"; // Idle loops park soon
+                else row.state = "parked";
+                rows.push_back(move(row));
             }
-            cout << "Game state reset for room " << roomId << ": " << gameStateToJson(gameStates[roomId]) << endl;
-            updatedState = gameStateToJson(gameStates[roomId]);
-            cout << "Mutex released in /reset for room " << roomId << endl;
-        } else {
-            cout << "Failed to acquire mutex in /reset for room " << roomId << " after 10 seconds" << endl;
+        }
+        for (const string& roomId : hibernatedRooms) {
+            Row row;
+            row.roomId = roomId;
+            row.state = "hibernated"; // On disk; nothing else is known without loading it
+            rows.push_back(move(row));
+        }
+        lock.unlock();
+
+        SortKey cost = key->second;
+        sort(rows.begin(), rows.end(), [cost](const Row& a, const Row& b) { return cost(a) > cost(b); });
+        json report = {{"sort", sortBy}, {"total_rooms", rows.size()}, {"rooms", json::array()}};
+        for (size_t i = 0; i < rows.size() && i < limit; i++) {
+            const Row& row = rows[i];
+            report["rooms"].push_back({{"room_id", row.roomId},
+                                       {"state", row.state},
+                                       {"players", row.players},
+                                       {"alive", row.alive},
+                                       {"segments", row.segments},
+                                       {"glow", row.glow},
+                                       {"bytes", row.bytes},
+                                       {"ticks", row.ticks},
+                                       {"tick_cpu_ms", {{"avg", row.cpuAvgMs}, {"p99", row.cpuP99Ms}, {"max", row.cpuMaxMs}}},
+                                       {"last_lateness_ms", row.latenessMs},
+                                       {"input_queue", row.inputs},
+                                       {"publish_backlog_ms", row.publishBacklogMs},
+                                       {"last_publish_ms", row.lastPublishMs},
+                                       {"throttle", row.throttle}});
+        }
+        res.set_content(report.dump(), "application/json");
+    });
+
+    // Timeline of the last few thousand spans on every thread, for
+    // ui.perfetto.dev or chrome://tracing. Recording is off unless
+    // GLOWRACE_TRACE=1 or POST /trace?enabled=1; ?clear=1 starts over.
+    svr.Get("/trace", [](const Request& req, Response& res) {
+        bool clear = req.has_param("clear") && req.get_param_value("clear") == "1";
+        res.set_content(glowtrace::dump(clear), "application/json");
+    });
+    svr.Post("/trace", [](const Request& req, Response& res) {
+        if (req.has_param("enabled")) glowtrace::setEnabled(req.get_param_value("enabled") == "1");
+        res.set_content(glowtrace::enabled() ? "{\"enabled\":true}" : "{\"enabled\":false}", "application/json");
+    });
+
+    // Input-to-frame latency for each room that has timed inputs, worst p99
+    // first, in milliseconds; the segments are those of
+    // glowrace_input_latency_seconds in /metrics
+    svr.Get("/latency", [](const Request& req, Response& res) {
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Latency, chrono::seconds(10));
+        if (!lock) {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /latency after 10 seconds";
             res.status = 503;
             res.set_content("{\"error\":\"Server busy, mutex timeout\"}", "application/json");
             return;
         }
-        res.set_content(updatedState, "application/json");
+        auto percentiles = [](const metrics::Distribution& segment) {
+            return json{{"p50", segment.quantileSeconds(0.5) * 1e3},
+                        {"p90", segment.quantileSeconds(0.9) * 1e3},
+                        {"p99", segment.quantileSeconds(0.99) * 1e3}};
+        };
+        vector<pair<double, json>> rows;
+        for (const auto& [roomId, room] : rooms) {
+            const InputLatency* latency = room->inputLatency.get();
+            if (!latency) continue;
+            json row = {{"room_id", roomId},
+                        {"inputs", latency->total.count()},
+                        {"ticks", room->ticks},
+                        {"last_input_tick", room->lastInputTick},
+                        {"forward", percentiles(latency->forward)},
+                        {"apply", percentiles(latency->apply)},
+                        {"tick_wait", percentiles(latency->tickWait)},
+                        {"tick", percentiles(latency->tick)},
+                        {"publish", percentiles(latency->publish)},
+                        {"total", percentiles(latency->total)}};
+            rows.emplace_back(latency->total.quantileSeconds(0.99), move(row));
+        }
+        lock.unlock();
+        sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        json report = {{"rooms", json::array()}};
+        for (auto& [p99, row] : rows) report["rooms"].push_back(move(row));
+        res.set_content(report.dump(), "application/json");
+    });
+
+    // Lock profile: every site that takes the game lock, most total wait
+    // first, to show which critical sections the tail latency comes from
+    svr.Get("/locks", [](const Request& req, Response& res) {
+        json report = {{"sites", json::array()}};
+        for (const metrics::LockSiteStats& site : metrics::lockSiteStats()) {
+            if (site.attempts == 0) continue;
+            report["sites"].push_back({{"site", metrics::lockSiteName(site.site)},
+                                       {"attempts", site.attempts},
+                                       {"contended", site.contended},
+                                       {"contended_ratio", static_cast<double>(site.contended) / site.attempts},
+                                       {"timeouts", site.timeouts},
+                                       {"wait_ms", {{"total", site.waitTotalMs}, {"p99", site.waitP99Ms}, {"max", site.waitMaxMs}}},
+                                       {"hold_ms", {{"total", site.holdTotalMs}, {"p99", site.holdP99Ms}, {"max", site.holdMaxMs}}}});
+        }
+        res.set_content(report.dump(), "application/json");
     });
 
-    cout << "C++ server running on port 9000..." << endl;
+    // Prometheus text format. The room gauges are left out when the game
+    // lock is busy, so the counters are still there to show why.
+    svr.Get("/metrics", [](const Request& req, Response& res) {
+        string out;
+        metrics::render(out);
+        ProfiledLock lock(gameStateMutex, metrics::LockSite::Metrics, chrono::seconds(1));
+        if (lock) {
+            static const double playerBounds[] = {0, 1, 2, 4, 8, 16, 32};
+            constexpr size_t count = sizeof(playerBounds) / sizeof(playerBounds[0]);
+            uint64_t buckets[count + 1] = {};
+            size_t players = 0, parked = 0, throttled = 0;
+            for (const auto& [roomId, room] : rooms) {
+                size_t n = room->state.playerCount();
+                players += n;
+                if (!gameThreads.count(roomId)) parked++;
+                if (room->tickStats.throttlePercent.load(memory_order_relaxed) > 100) throttled++;
+                buckets[lower_bound(playerBounds, playerBounds + count, static_cast<double>(n)) - playerBounds]++;
+            }
+            metrics::appendGauge(out, "glowrace_rooms_live", "Resident rooms with a running game loop", rooms.size() - parked);
+            metrics::appendGauge(out, "glowrace_rooms_parked", "Resident rooms whose loop has parked", parked);
+            metrics::appendGauge(out, "glowrace_rooms_throttled", "Rooms ticking slower than normal to stay within their CPU budget",
+                                 throttled);
+            metrics::appendGauge(out, "glowrace_rooms_hibernated", "Rooms written to disk to stay under the memory budget",
+                                 hibernatedRooms.size());
+            metrics::appendHistogram(out, "glowrace_room_players", "Players in each resident room, as of this scrape",
+                                     playerBounds, buckets, count, players);
+        } else {
+            GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex in /metrics after 1 second; serving counters only";
+        }
+        res.set_content(out, "text/plain; version=0.0.4");
+    });
+
+    svr.Post("/reset", handleReset);
+    svr.Post("/create_room", handleCreateRoom);
+
+    // A follower or successor serves nothing until it has taken over
+    bool tookOver = false;
+    unique_ptr<FrameReader> predecessor;
+    if (predecessorFd >= 0) {
+        GLOWRACE_LOG(Info) << "Taking over from the server on " << handoffPath;
+        predecessor = make_unique<FrameReader>(predecessorFd);
+        if (!takeOverFrom(*predecessor)) {
+            GLOWRACE_LOG(Error) << "Previous server went away mid-handoff; exiting";
+            return 1;
+        }
+        tookOver = true;
+    } else if (const char* path = getenv("GLOWRACE_FOLLOW")) {
+        followLeader(path);
+        tookOver = true;
+    }
+    if (!checkpointPath.empty()) {
+        if (!tookOver) resumeFromCheckpoint();
+        GLOWRACE_LOG(Info) << "Checkpointing rooms to " << checkpointPath << " every " << checkpointEvery.count() << " s";
+    }
+    if (const char* path = getenv("GLOWRACE_REPLICATE")) {
+        startReplication(path);
+    }
+
+    if (!svr.bind_to_port("0.0.0.0", 9000)) {
+        GLOWRACE_LOG(Error) << "Failed to bind port 9000";
+        return 1;
+    }
+    GLOWRACE_LOG(Info) << "C++ server running on port 9000...";
     thread serverThread([&svr]() {
-        svr.listen("0.0.0.0", 9000);
+        svr.listen_after_bind();
     });
+    if (predecessor) {
+        // Both servers accept on the port now; the old one can stop
+        string frame;
+        appendFrame(frame, "", "listening");
+        writeAll(predecessorFd, frame.data(), frame.size());
+        thread(serveForwardedRequests, move(predecessor), predecessorFd).detach();
+    } else if (!handoffPath.empty()) {
+        startHandoffListener();
+    }
+    signal(SIGTERM, requestShutdown);
+    signal(SIGINT, requestShutdown);
 
-    // Main loop to monitor and clean up
-    while (true) {
-        vector<string> roomsToReset;
-        {
-            cout << "Acquiring mutex for shouldReset check" << endl;
-            if (gameStateMutex.try_lock_for(chrono::seconds(10))) {
-                lock_guard<timed_mutex> lock(gameStateMutex, adopt_lock);
-                cout << "Mutex acquired for shouldReset check" << endl;
-                for (auto& pair : gameStates) {
-                    if (shouldResetGameState(pair.second)) {
-                        roomsToReset.push_back(pair.first);
-                        pair.second = loadGameState(pair.first);
-                        cout << "Game state reset to loaded state for room " << pair.first << ": " << gameStateToJson(pair.second) << endl;
-                    }
+    // Main loop to monitor and clean up. Resets are queued by the rooms
+    // themselves, so the lock is only taken for the memory budget and replay logs.
+    auto lastCheckpoint = chrono::steady_clock::now();
+    thread(resetWorker).detach();
+    while (!shutdownRequested) {
+        vector<pair<int, string>> replayWrites;
+        unique_lock<mutex> replayWriting(replayWriteMutex, defer_lock);
+        if (memoryBudget > 0 || !replayDir.empty()) {
+            GLOWRACE_LOG(Trace) << "Acquiring mutex for monitor";
+            ProfiledLock lock(gameStateMutex, metrics::LockSite::Monitor, chrono::seconds(10));
+            if (lock) {
+                GLOWRACE_LOG(Trace) << "Mutex acquired for monitor";
+                // Frozen rooms are left exactly as they were handed over
+                if (!draining) enforceMemoryBudget();
+                // Only this thread closes replay logs, so the fds stay open until written
+                replayWriting.lock();
+                for (auto& [roomId, room] : rooms) {
+                    if (room->replay && !room->replay->empty()) replayWrites.emplace_back(room->replayFd, room->replay->take());
                 }
-                cout << "Mutex released for shouldReset check" << endl;
+                GLOWRACE_LOG(Trace) << "Mutex released for monitor";
             } else {
-                cout << "Failed to acquire mutex for shouldReset check after 10 seconds" << endl;
+                GLOWRACE_LOG_SAMPLED(Warn, 1) << "Failed to acquire mutex for monitor after 10 seconds";
             }
         }
-        for (const auto& roomId : roomsToReset) {
-            sendGameState(roomId);
+        for (const auto& [fd, bytes] : replayWrites) {
+            writeReplay(fd, bytes);
+        }
+        if (replayWriting) replayWriting.unlock();
+        if (!checkpointPath.empty() && !draining && chrono::steady_clock::now() - lastCheckpoint >= checkpointEvery) {
+            checkpointRooms();
+            lastCheckpoint = chrono::steady_clock::now();
         }
 
         this_thread::sleep_for(chrono::milliseconds(500));
     }
 
-    // Cleanup threads on shutdown (not fully implemented here, handle with signal handlers in production)
-    for (auto& [roomId, thread] : gameThreads) {
-        if (thread.joinable()) thread.join();
+    // Drain: freeze the rooms, stop accepting and let in-flight requests
+    // finish. After a handoff they run on the successor; otherwise the rooms
+    // are checkpointed one last time.
+    auto drainStart = chrono::steady_clock::now();
+    vector<pair<int, string>> replayWrites;
+    {
+        lock_guard<timed_mutex> lock(gameStateMutex);
+        draining = true;
     }
+    svr.stop();
     serverThread.join();
-    return 0;
-}
\ No newline at end of file
+    {
+        lock_guard<timed_mutex> lock(gameStateMutex);
+        for (auto& [roomId, room] : rooms) {
+            if (room->replay && !room->replay->empty()) replayWrites.emplace_back(room->replayFd, room->replay->take());
+        }
+    }
+    for (const auto& [fd, bytes] : replayWrites) {
+        writeReplay(fd, bytes);
+    }
+    bool handedOff;
+    {
+        lock_guard<mutex> lock(successorMutex);
+        handedOff = successorFd >= 0;
+        if (handedOff) shutdown(successorFd, SHUT_RDWR);
+    }
+    if (!handedOff && !checkpointPath.empty()) checkpointRooms();
+    if (handedOff && replicating) {
+        // Keep the follower on standby for the successor rather than taking over
+        replicationLeader.send("", "restarting");
+        replicationLeader.flush(chrono::seconds(2));
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - drainStart).count();
+    GLOWRACE_LOG(Info) << "Drained in " << ms << " ms; exiting";
+    // Parked loops are detached and the HTTP and replication threads never
+    // return, so skip static destructors rather than join them
+    quick_exit(0);
+}
@@ -0,0 +1,231 @@
+#include "snapshot.h"
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const char kMagic[4] = {'G', 'R', 'S', 'N'};
+
+void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putWord(string& out, uint64_t value) {
+    for (int b = 0; b < 8; ++b) out.push_back(static_cast<char>(value >> (8 * b)));
+}
+
+void putText(string& out, string_view text) {
+    putVarint(out, text.size());
+    out.append(text.data(), text.size());
+}
+
+void putCell(string& out, const Position& pos) {
+    putVarint(out, static_cast<uint64_t>(pos.row));
+    putVarint(out, static_cast<uint64_t>(pos.col));
+}
+
+// Bounds-checked cursor over the image; any overrun latches ok to false
+struct Reader {
+    const unsigned char* at;
+    const unsigned char* end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at == end) break;
+            unsigned char byte = *at++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    uint64_t word() {
+        if (end - at < 8) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int b = 0; b < 8; ++b) value |= static_cast<uint64_t>(at[b]) << (8 * b);
+        at += 8;
+        return value;
+    }
+
+    uint8_t byte() {
+        if (at == end) {
+            ok = false;
+            return 0;
+        }
+        return *at++;
+    }
+
+    string_view text() {
+        uint64_t length = varint();
+        if (!ok || static_cast<uint64_t>(end - at) < length) {
+            ok = false;
+            return {};
+        }
+        string_view view(reinterpret_cast<const char*>(at), length);
+        at += length;
+        return view;
+    }
+
+    Position cell(int gridSize) {
+        uint64_t row = varint();
+        uint64_t col = varint();
+        if (row >= static_cast<uint64_t>(gridSize) || col >= static_cast<uint64_t>(gridSize)) ok = false;
+        return {static_cast<int>(row), static_cast<int>(col)};
+    }
+
+    // A count that cannot exceed what is left of the image
+    size_t count(size_t minBytesEach) {
+        uint64_t n = varint();
+        if (n > static_cast<uint64_t>(end - at) / minBytesEach) ok = false;
+        return ok ? static_cast<size_t>(n) : 0;
+    }
+};
+
+} // namespace
+
+void encodeSnapshot(const GameState& state, int gridSize, string& out) {
+    out.append(kMagic, sizeof(kMagic));
+    out.push_back(static_cast<char>(kSnapshotVersion));
+    putVarint(out, static_cast<uint64_t>(gridSize));
+    putWord(out, state.seed);
+    for (uint64_t word : state.rng.s) putWord(out, word);
+    out.push_back(state.gameOver ? 1 : 0);
+    putVarint(out, static_cast<uint64_t>(state.initialPlayerCount));
+
+    putVarint(out, state.slotCount());
+    for (size_t i = 0; i < state.slotCount(); ++i) {
+        out.push_back(static_cast<char>(state.occupied[i]));
+        putVarint(out, state.generations[i]);
+        if (!state.occupied[i]) continue;
+        out.push_back(static_cast<char>(state.alive[i]));
+        out.push_back(static_cast<char>(state.directions[i]));
+        putVarint(out, static_cast<uint64_t>(state.scores[i]));
+        putCell(out, state.heads[i]);
+        putText(out, state.idOf(i));
+        putText(out, state.names[i]);
+        const Body& body = state.body(i);
+        putVarint(out, body.size());
+        for (size_t k = 0; k < body.size(); ++k) putCell(out, body[k]);
+    }
+
+    putVarint(out, state.freeSlots.size());
+    for (uint32_t slot : state.freeSlots) putVarint(out, slot);
+    putVarint(out, state.glowPoints.size());
+    for (const Cell& glow : state.glowPoints) putCell(out, glow);
+}
+
+bool decodeSnapshot(const char* data, size_t size, int gridSize, GameState& state) {
+    if (size < sizeof(kMagic) + 1 || memcmp(data, kMagic, sizeof(kMagic)) != 0) return false;
+    Reader in{reinterpret_cast<const unsigned char*>(data) + sizeof(kMagic),
+              reinterpret_cast<const unsigned char*>(data) + size};
+    if (in.byte() != kSnapshotVersion || in.varint() != static_cast<uint64_t>(gridSize)) return false;
+
+    state.seed = in.word();
+    for (uint64_t& word : state.rng.s) word = in.word();
+    state.gameOver = in.byte() != 0;
+    state.initialPlayerCount = static_cast<int>(in.varint());
+
+    size_t slots = in.count(2);
+    for (size_t i = 0; i < slots && in.ok; ++i) {
+        uint8_t occupied = in.byte();
+        uint32_t generation = static_cast<uint32_t>(in.varint());
+        // Every slot gets a body; a free slot's goes on the free list below
+        uint32_t handle = static_cast<uint32_t>(state.bodies.size());
+        state.bodies.emplace_back();
+        state.heads.push_back({0, 0});
+        state.directions.push_back(Direction::Right);
+        state.alive.push_back(0);
+        state.scores.push_back(0);
+        state.bodyHandles.push_back(handle);
+        state.occupied.push_back(occupied ? 1 : 0);
+        state.generations.push_back(generation);
+        state.ids.emplace_back();
+        state.names.emplace_back();
+        if (!occupied) continue;
+
+        state.alive[i] = in.byte() ? 1 : 0;
+        uint8_t direction = in.byte();
+        if (direction > static_cast<uint8_t>(Direction::Right)) in.ok = false;
+        state.directions[i] = static_cast<Direction>(direction);
+        state.scores[i] = static_cast<int>(in.varint());
+        state.heads[i] = in.cell(gridSize);
+        string_view id = in.text();
+        state.ids[i].assign(id);
+        if (state.ids[i].spilled()) state.longIds[static_cast<uint32_t>(i)].assign(id.data(), id.size());
+        string_view name = in.text();
+        state.names[i].assign(name.data(), name.size());
+        // Stored newest first, so push the oldest segment first
+        size_t length = in.count(2);
+        vector<Position> segments(length);
+        for (size_t k = 0; k < length && in.ok; ++k) segments[k] = in.cell(gridSize);
+        Body& body = state.bodies[handle];
+        for (size_t k = length; k-- > 0;) body.pushFront(segments[k]);
+    }
+
+    size_t freeCount = in.count(1);
+    vector<uint8_t> listed(slots, 0);
+    for (size_t f = 0; f < freeCount && in.ok; ++f) {
+        uint64_t slot = in.varint();
+        if (slot >= state.slotCount() || state.occupied[slot] || listed[slot]) {
+            in.ok = false;
+            break;
+        }
+        listed[slot] = 1;
+        state.freeSlots.push_back(static_cast<uint32_t>(slot));
+        state.freeBodies.push_back(state.bodyHandles[slot]);
+    }
+    size_t glowCount = in.count(2);
+    for (size_t g = 0; g < glowCount && in.ok; ++g) state.glowPoints.push_back(in.cell(gridSize));
+
+    if (!in.ok || in.at != in.end) return false;
+    state.reindex();
+    return true;
+}
+
+namespace {
+
+struct Fnv {
+    uint64_t hash = 1469598103934665603ULL;
+
+    void bytes(const void* data, size_t size) {
+        const unsigned char* at = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ at[i]) * 1099511628211ULL;
+    }
+    void value(uint64_t v) { bytes(&v, sizeof(v)); }
+    void cell(const Position& pos) { value((static_cast<uint64_t>(pos.row) << 32) | static_cast<uint32_t>(pos.col)); }
+};
+
+} // namespace
+
+uint64_t stateChecksum(const GameState& state) {
+    Fnv fnv;
+    fnv.bytes(state.rng.s, sizeof(state.rng.s));
+    fnv.value(state.gameOver);
+    fnv.value(state.slotCount());
+    for (size_t i = 0; i < state.slotCount(); ++i) {
+        fnv.value(state.occupied[i]);
+        if (!state.occupied[i]) continue;
+        string_view id = state.idOf(i);
+        fnv.bytes(id.data(), id.size());
+        fnv.cell(state.heads[i]);
+        fnv.value((static_cast<uint64_t>(state.directions[i]) << 8) | state.alive[i]);
+        fnv.value(static_cast<uint64_t>(state.scores[i]));
+        const Body& body = state.body(i);
+        fnv.value(body.size());
+        for (size_t k = 0; k < body.size(); ++k) fnv.cell(body[k]);
+    }
+    fnv.value(state.glowPoints.size());
+    for (const Cell& glow : state.glowPoints) fnv.cell(glow);
+    return fnv.hash;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "game.h"
+#include <string>
+
+// Compact binary image of one room's GameState, used to park rooms on disk.
+// Everything a tick depends on is kept, including the Rng state and the slot
+// layout with its free list and generations, so a decoded room continues
+// exactly where the encoded one stopped. Integers are LEB128 varints except
+// the seed and Rng words; cells are two varints, usually a byte each.
+//
+//   "GRSN" version gridSize seed rng[4] gameOver initialPlayerCount
+//   slotCount { occupied generation [alive direction score head id name tail] }
+//   freeSlots glowPoints
+
+constexpr uint8_t kSnapshotVersion = 1;
+
+// Appends the snapshot of state to out
+void encodeSnapshot(const GameState& state, int gridSize, std::string& out);
+
+// Rebuilds state from a snapshot taken on a board of the same size. state
+// should be freshly constructed on the resource it is meant to live in.
+// Returns false, leaving state unusable, on a truncated or foreign image.
+bool decodeSnapshot(const char* data, size_t size, int gridSize, GameState& state);
+
+// FNV-1a over everything a tick reads or writes: the Rng, gameOver, the slot
+// layout and each occupied slot's id, head, direction, alive flag, score and
+// tail, and the glow points. Two rooms with equal checksums play on alike.
+uint64_t stateChecksum(const GameState& state);
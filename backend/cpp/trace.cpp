@@ -0,0 +1,173 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace glowtrace {
+
+atomic<bool> active{false};
+
+namespace {
+
+// Rings of threads that have exited are kept for the next dump, up to this
+// many; a parked room's loop is often the one worth looking at
+constexpr size_t kRetiredRings = 256;
+
+struct Event {
+    const char* name;
+    int64_t beginNs;
+    int64_t endNs;
+    uint8_t argLength;
+    char arg[kMaxArg];
+};
+
+// Written by its thread and read by dumps. The mutex is only ever contended
+// while a dump copies the ring out.
+struct Ring {
+    mutex lock;
+    vector<Event> events = vector<Event>(kEventsPerThread);
+    size_t written = 0;
+    uint32_t tid = 0;
+    string threadName;
+    bool retired = false;
+};
+
+mutex ringsMutex;
+vector<shared_ptr<Ring>> rings;
+uint32_t nextTid = 1;
+
+// The calling thread's ring, made the first time the thread records while
+// tracing is on, and kept after the thread exits
+struct ThreadRing {
+    shared_ptr<Ring> ring;
+
+    ~ThreadRing() {
+        if (!ring) return;
+        lock_guard<mutex> lock(ringsMutex);
+        ring->retired = true;
+        size_t retired = count_if(rings.begin(), rings.end(), [](const shared_ptr<Ring>& r) { return r->retired; });
+        if (retired <= kRetiredRings) return;
+        rings.erase(find_if(rings.begin(), rings.end(), [](const shared_ptr<Ring>& r) { return r->retired; }));
+    }
+};
+
+thread_local ThreadRing threadRing;
+thread_local string threadName; // Set before the ring exists, copied into it
+
+Ring& ownRing() {
+    if (!threadRing.ring) {
+        auto ring = make_shared<Ring>();
+        ring->threadName = threadName;
+        lock_guard<mutex> lock(ringsMutex);
+        ring->tid = nextTid++;
+        rings.push_back(ring);
+        threadRing.ring = move(ring);
+    }
+    return *threadRing.ring;
+}
+
+int64_t toNs(chrono::steady_clock::time_point time) {
+    return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+void appendEscaped(string& out, string_view text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out.append(escaped);
+        } else {
+            out.push_back(c);
+        }
+    }
+}
+
+void appendMicros(string& out, int64_t ns) {
+    char digits[32];
+    snprintf(digits, sizeof(digits), "%.3f", static_cast<double>(ns) / 1000.0);
+    out.append(digits);
+}
+
+} // namespace
+
+void setEnabled(bool on) {
+    active.store(on, memory_order_relaxed);
+}
+
+void nameThread(string_view name) {
+    threadName.assign(name.data(), name.size());
+    if (threadRing.ring) {
+        lock_guard<mutex> lock(threadRing.ring->lock);
+        threadRing.ring->threadName = threadName;
+    }
+}
+
+void record(const char* name, chrono::steady_clock::time_point begin, chrono::steady_clock::time_point end,
+            string_view arg) {
+    Ring& ring = ownRing();
+    lock_guard<mutex> lock(ring.lock);
+    Event& event = ring.events[ring.written++ % kEventsPerThread];
+    event.name = name;
+    event.beginNs = toNs(begin);
+    event.endNs = toNs(end);
+    event.argLength = static_cast<uint8_t>(arg.copy(event.arg, kMaxArg));
+}
+
+string dump(bool clear) {
+    vector<shared_ptr<Ring>> snapshot;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+    string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separate = [&]() {
+        if (!first) out.push_back(',');
+        first = false;
+    };
+    vector<Event> events;
+    for (const auto& ring : snapshot) {
+        string name;
+        uint32_t tid;
+        {
+            lock_guard<mutex> lock(ring->lock);
+            size_t kept = min(ring->written, kEventsPerThread);
+            events.clear();
+            for (size_t i = ring->written - kept; i < ring->written; i++) events.push_back(ring->events[i % kEventsPerThread]);
+            if (clear) ring->written = 0;
+            name = ring->threadName;
+            tid = ring->tid;
+        }
+        if (events.empty()) continue;
+        separate();
+        out.append("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":").append(to_string(tid));
+        out.append(",\"args\":{\"name\":\"");
+        appendEscaped(out, name.empty() ? "thread " + to_string(tid) : name);
+        out.append("\"}}");
+        for (const Event& event : events) {
+            separate();
+            out.append("{\"ph\":\"X\",\"name\":\"").append(event.name).append("\",\"pid\":1,\"tid\":").append(to_string(tid));
+            out.append(",\"ts\":");
+            appendMicros(out, event.beginNs);
+            out.append(",\"dur\":");
+            appendMicros(out, event.endNs - event.beginNs);
+            if (event.argLength > 0) {
+                out.append(",\"args\":{\"detail\":\"");
+                appendEscaped(out, string_view(event.arg, event.argLength));
+                out.append("\"}");
+            }
+            out.push_back('}');
+        }
+    }
+    out.append("]}");
+    return out;
+}
+
+} // namespace glowtrace
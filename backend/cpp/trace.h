@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Opt-in timeline tracing of room ticks and requests, exported in the Chrome
+// trace event format (chrome://tracing, ui.perfetto.dev).
+//
+//   glowtrace::Span span("collide");
+//
+// records the enclosing scope as one complete event on the calling thread.
+// While tracing is off a span is one relaxed load. While it is on, events go
+// into a fixed ring per thread, so each thread keeps its last kEventsPerThread
+// events and tracing never grows memory past that.
+
+namespace glowtrace {
+
+constexpr size_t kEventsPerThread = 4096;
+constexpr size_t kMaxArg = 39; // Longer args, e.g. room ids, are cut short
+
+extern std::atomic<bool> active;
+
+inline bool enabled() {
+    return active.load(std::memory_order_relaxed);
+}
+void setEnabled(bool on);
+
+// Labels the calling thread in the timeline, e.g. with the room it runs
+void nameThread(std::string_view name);
+
+// name must be a string literal or otherwise live for the whole process
+void record(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end,
+            std::string_view arg = {});
+
+// Every thread's events as a Chrome trace JSON object; clear empties the
+// rings so the next dump starts fresh
+std::string dump(bool clear);
+
+class Span {
+public:
+    explicit Span(const char* name, std::string_view arg = {}) : name(enabled() ? name : nullptr) {
+        if (!this->name) return;
+        setArg(arg);
+        begin = std::chrono::steady_clock::now();
+    }
+    ~Span() {
+        if (name) record(name, begin, std::chrono::steady_clock::now(), std::string_view(arg, argLength));
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    // For an arg only known partway through the span; copied
+    void setArg(std::string_view value) {
+        if (!name) return;
+        argLength = value.copy(arg, kMaxArg);
+    }
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point begin;
+    size_t argLength = 0;
+    char arg[kMaxArg];
+};
+
+} // namespace glowtrace
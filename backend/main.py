@@ -7,6 +7,7 @@ from pydantic import BaseModel
 import redis.asyncio as redis
 import httpx
 import asyncio
+import time
 from typing import Dict, List
 import logging
 
@@ -81,6 +82,14 @@ async def create_room(type: str):
 
     connections[room_id] = []
 
+    # The room is known to be empty, so the game server can set it up from its
+    # pool now instead of loading it on the first action
+    async with httpx.AsyncClient(timeout=2.0) as client:
+        try:
+            await client.post("http://cpp-server:9000/create_room", params={"room_id": room_id})
+        except httpx.RequestError as e:
+            logger.warning(f"Could not set up room {room_id} on the game server: {e}")
+
     logger.info(f"Created room {room_id} of type {type}")
     return JSONResponse({"room_id": room_id})
 
@@ -208,7 +217,9 @@ async def load_state(room_id: str):
 async def player_action(action: PlayerActionRequest):
     async with httpx.AsyncClient(timeout=5.0) as client:
         try:
-            response = await client.post("http://cpp-server:9000/update", json=action.dict(exclude_none=True))
+            payload = action.dict(exclude_none=True)
+            payload["received_at_ms"] = time.time() * 1000  # Lets the C++ server time the forwarding hop
+            response = await client.post("http://cpp-server:9000/update", json=payload)
             response.raise_for_status()
             logger.info(f"Action sent to C++ server for room {action.room_id}: {action}")
             return response.json()
@@ -251,6 +262,8 @@ async def websocket_endpoint(websocket: WebSocket, room_id: str):
         
         while True:
             data = await websocket.receive_json()
+            if isinstance(data, dict):  # Anything else goes on as sent for the C++ server to reject
+                data["received_at_ms"] = time.time() * 1000  # Lets the C++ server time the forwarding hop
             async with httpx.AsyncClient(timeout=5.0) as client:
                 try:
                     response = await client.post("http://cpp-server:9000/update", json=data)